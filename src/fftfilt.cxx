@@ -35,6 +35,9 @@
 #include <cstdlib>
 #include <cmath>
 #include <typeinfo>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include <stdio.h>
 #include <sys/types.h>
@@ -77,6 +80,24 @@ void fftfilt::init_filter()
 	output		= new cmplx[flen];
 	ovlbuf		= new cmplx[flen2];
 	ht			= new cmplx[flen];
+
+	ift			= 0;
+	decimation	= 1;
+	dlen		= flen;
+	folded		= 0;
+	band		= new int[flen];
+	band_len	= 0;
+}
+
+// the bins the filter passes: the filters have a unity gain, and the
+// bins below -120 dB (such as the Nyquist bin rtty_filter() leaves from
+// the lowpass response) are left out
+void fftfilt::find_band()
+{
+	band_len = 0;
+	for (int i = 0; i < flen; i++)
+		if (abs(filter[i]) > 1e-6)
+			band[band_len++] = i;
 }
 
 // number of samples needed to completely flush the filter
@@ -85,6 +106,16 @@ int fftfilt::flush_size()
 	return flen - inptr;
 }
 
+// memory used by this filter, FFT tables included
+size_t fftfilt::footprint() const
+{
+	size_t size = sizeof(*this) + (5 * flen + flen2) * sizeof(cmplx) +
+		flen * sizeof(int) + fft->footprint();
+	if (ift)
+		size += dlen * sizeof(cmplx) + ift->footprint();
+	return size;
+}
+
 //------------------------------------------------------------------------------
 // fft filter
 // f1 < f2 ==> band pass filter
@@ -112,6 +143,7 @@ fftfilt::fftfilt(double f, int len)
 fftfilt::~fftfilt()
 {
 	if (fft) delete fft;
+	if (ift) delete ift;
 
 	if (filter) delete [] filter;
 	if (timedata) delete [] timedata;
@@ -119,6 +151,8 @@ fftfilt::~fftfilt()
 	if (output) delete [] output;
 	if (ovlbuf) delete [] ovlbuf;
 	if (ht) delete [] ht;
+	if (folded) delete [] folded;
+	if (band) delete [] band;
 }
 
 void fftfilt::create_filter(double f1, double f2)
@@ -191,10 +225,43 @@ void fftfilt::create_filter(double f1, double f2)
 	fspec.close();
 	delete [] revht;
 */
+	find_band();
 // start output after 2 full passes are complete
 	pass = 1;
 }
 
+bool fftfilt::set_decimation(int factor)
+{
+	if (factor < 1 || (factor & (factor - 1)) != 0 ||
+		(factor > 1 && flen / factor < 16))
+		return false;
+	int len = flen / factor;
+// the passband, around DC, must fit in len bins
+	int width = 0;
+	for (int j = 0; j < band_len; j++) {
+		int dist = band[j] <= flen2 ? band[j] : flen - band[j];
+		if (dist > width) width = dist;
+	}
+	if (2 * width + 1 > len)
+		return false;
+
+	if (ift) delete ift;
+	if (folded) delete [] folded;
+	ift = 0;
+	folded = 0;
+	decimation = factor;
+	dlen = len;
+	if (decimation > 1) {
+		ift = new g_fft<double>(dlen);
+		folded = new cmplx[dlen];
+	}
+	for (int i = 0; i < flen2; i++)
+		ovlbuf[i] = 0;
+	inptr = 0;
+	pass = 1;
+	return true;
+}
+
 /*
  * Filter with fast convolution (overlap-add algorithm).
  */
@@ -212,6 +279,32 @@ int fftfilt::run(const cmplx & in, cmplx **out)
 	memcpy(freqdata, timedata, flen * sizeof(cmplx));
 	fft->ComplexFFT(freqdata);
 
+	if (decimation > 1) {
+// multiply the passband with the filter shape, and fold it into dlen
+// bins: their inverse FFT is every decimation-th sample of the full
+// inverse FFT (scaled by decimation)
+		for (int i = 0; i < dlen; i++)
+			folded[i] = 0;
+		for (int j = 0; j < band_len; j++) {
+			int i = band[j];
+			folded[i & (dlen - 1)] += freqdata[i] * filter[i];
+		}
+		ift->InverseComplexFFT(folded);
+
+		int dlen2 = dlen >> 1;
+		double scale = 1.0 / decimation;
+		for (int i = 0; i < dlen2; i++) {
+			output[i] = ovlbuf[i] + folded[i] * scale;
+			ovlbuf[i] = folded[i + dlen2] * scale;
+		}
+
+		inptr = 0;
+		if (pass) return 0;
+
+		*out = output;
+		return dlen2;
+	}
+
 // multiply with the filter shape
 	for (int i = 0; i < flen; i++)
 		freqdata[i] *= filter[i];
@@ -309,7 +402,176 @@ void fftfilt::rtty_filter(double f)
 	fspec.close();
 	delete [] revht;
 */
+	find_band();
 // start output after 2 full passes are complete
 	pass = 1;
 }
 
+
+//------------------------------------------------------------------------------
+// compact mark/space filter pair
+//------------------------------------------------------------------------------
+
+// FFT tables and rtty_filter() response, shared by all the instances
+// with the same length, cutoff and decimation
+struct fftfilt_fsk::shared_response {
+	g_fft<float> fft;
+	cmplxf *filter;
+// decimating mode: the reduced inverse FFT and the passband
+	g_fft<float> *ift;
+	int dlen;
+	std::vector<int> band;
+
+	shared_response(double f, int len, int decimation) : fft(len), ift(0) {
+// use the double precision filter to compute the response
+		fftfilt proto(f, len);
+		proto.rtty_filter(f);
+		filter = new cmplxf[len];
+		for (int i = 0; i < len; i++)
+			filter[i] = cmplxf(proto.filter[i]);
+		dlen = len;
+		if (decimation > 1 && proto.set_decimation(decimation)) {
+			dlen = len / decimation;
+			ift = new g_fft<float>(dlen);
+			band.assign(proto.band, proto.band + proto.band_len);
+		}
+	}
+	~shared_response() {
+		delete [] filter;
+		delete ift;
+	}
+};
+
+std::shared_ptr<fftfilt_fsk::shared_response>
+fftfilt_fsk::get_shared(double f, int len, int decimation)
+{
+	static std::mutex mutex;
+	static std::map<std::pair<std::pair<int, int>, double>,
+					std::weak_ptr<shared_response> > responses;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::weak_ptr<shared_response> & entry =
+		responses[std::make_pair(std::make_pair(len, decimation), f)];
+	std::shared_ptr<shared_response> response = entry.lock();
+	if (!response) {
+		response = std::make_shared<shared_response>(f, len, decimation);
+		entry = response;
+	}
+	return response;
+}
+
+// decimation: as in fftfilt::set_decimation(); when the passband does not
+// allow it, the output is not decimated (see get_decimation())
+fftfilt_fsk::fftfilt_fsk(double f, int len, double mark_f, double space_f,
+						 double samplerate, int decimation)
+{
+	flen	= len;
+	flen2	= len >> 1;
+	shared	= get_shared(f, len, decimation);
+	this->decimation = len / shared->dlen;
+	dlen2	= shared->dlen >> 1;
+
+	inptr = 0;
+// start output after 2 full passes are complete
+	pass = 1;
+	mark_phase = 0;
+	space_phase = 0;
+// same expression as the mixer in navtex_rx, so the phases stay identical
+	mark_step = 2.0 * M_PI * mark_f / samplerate;
+	space_step = 2.0 * M_PI * space_f / samplerate;
+
+	timedata = new float[flen2];
+	mark_ovlbuf = new cmplxf[flen2];
+	space_ovlbuf = new cmplxf[flen2];
+	for (int i = 0; i < flen2; i++) {
+		timedata[i] = 0;
+		mark_ovlbuf[i] = 0;
+		space_ovlbuf[i] = 0;
+	}
+}
+
+fftfilt_fsk::~fftfilt_fsk()
+{
+	delete [] timedata;
+	delete [] mark_ovlbuf;
+	delete [] space_ovlbuf;
+}
+
+// per channel memory; the shared response and the per thread work area
+// are not included
+size_t fftfilt_fsk::footprint() const
+{
+	return sizeof(*this) + flen2 * sizeof(float) + 2 * flen2 * sizeof(cmplxf);
+}
+
+// mix the buffered input down, filter it with overlap-add and leave the
+// flen/2 (decimated: flen/2/decimation) output samples at the start of
+// work
+void fftfilt_fsk::filter_block(double & phase, double step, cmplxf *work,
+							   cmplxf *ovlbuf)
+{
+	for (int i = 0; i < flen2; i++) {
+		double v = timedata[i];
+		work[i] = cmplxf(cmplx(cos(phase), sin(phase)) * cmplx(v, v));
+		phase -= step;
+		if (phase < -2.0 * M_PI) phase += 2.0 * M_PI;
+	}
+	for (int i = flen2; i < flen; i++)
+		work[i] = 0;
+
+	shared->fft.ComplexFFT(work);
+
+	if (decimation > 1) {
+// as in fftfilt::run(), with the passband folded in a work area of its
+// own
+		int dlen = shared->dlen;
+		static thread_local std::vector<cmplxf> fold;
+		fold.assign(dlen, 0);
+		for (int i : shared->band)
+			fold[i & (dlen - 1)] += work[i] * shared->filter[i];
+		shared->ift->InverseComplexFFT(&fold[0]);
+
+		float scale = 1.0f / decimation;
+		for (int i = 0; i < dlen2; i++) {
+			work[i] = ovlbuf[i] + fold[i] * scale;
+			ovlbuf[i] = fold[i + dlen2] * scale;
+		}
+		return;
+	}
+
+	for (int i = 0; i < flen; i++)
+		work[i] *= shared->filter[i];
+	shared->fft.InverseComplexFFT(work);
+
+// in place: work[i] is read before being overwritten
+	for (int i = 0; i < flen2; i++) {
+		work[i] += ovlbuf[i];
+		ovlbuf[i] = work[i + flen2];
+	}
+}
+
+int fftfilt_fsk::run(double in, cmplxf **mark_out, cmplxf **space_out)
+{
+// collect flen/2 input samples
+	timedata[inptr++] = in;
+
+	if (inptr < flen2)
+		return 0;
+	if (pass) --pass; // filter output is not stable until 2 passes
+
+// the work area grows only the first time a longer filter runs on a thread
+	static thread_local std::vector<cmplxf> work;
+	if ((int)work.size() < 2 * flen)
+		work.resize(2 * flen);
+
+	filter_block(mark_phase, mark_step, &work[0], mark_ovlbuf);
+	filter_block(space_phase, space_step, &work[flen], space_ovlbuf);
+
+	inptr = 0;
+
+	if (pass) return 0;
+
+	*mark_out = &work[0];
+	*space_out = &work[flen];
+	return dlen2;
+}
@@ -21,6 +21,8 @@
 #ifndef	_FFTFILT_H
 #define	_FFTFILT_H
 
+#include <memory>
+
 #include "complex.h"
 #include "gfft.h"
 
@@ -43,6 +45,14 @@ protected:
 	int inptr;
 	int pass;
 	int window;
+// decimating mode (see set_decimation())
+	int decimation;
+	int dlen;
+	cmplx *folded;
+	int *band;
+	int band_len;
+
+	friend class fftfilt_fsk;
 
 	inline double fsinc(double fc, int i, int len) {
 		return (i == len/2) ? 2.0 * fc: 
@@ -55,6 +65,7 @@ protected:
 	}
 	void init_filter();
 	void clear_filter();
+	void find_band();
 
 public:
 	fftfilt(double f1, double f2, int len);
@@ -70,9 +81,73 @@ public:
 		create_filter(f, 0);
 	}
 	void rtty_filter(double);
+// Output only every factor-th sample (factor: a power of two, with
+// flen/factor at least 16). After the multiply only the bins the filter
+// passes are kept, folded into flen/factor bins, and a flen/factor point
+// inverse FFT gives the decimated output directly: run() returns
+// flen/2/factor samples per block. False (and no change) when the
+// passband does not fit in flen/factor bins, as the output would alias.
+// The filter is reset.
+	bool set_decimation(int factor);
+	int get_decimation() const { return decimation; }
 
 	int run(const cmplx& in, cmplx **out);
 	int flush_size();
+	size_t footprint() const;
+};
+
+//----------------------------------------------------------------------
+// Compact mark/space filter pair, for running many channels at once
+//
+// The real input is mixed down by two local oscillators (mark and space)
+// and both products go through the same rtty_filter() response.
+// To keep the state of each instance small:
+// - the real input is buffered once, and mixed when a block is complete
+// - the buffers are single precision
+// - the FFT tables and the filter response are shared by all the
+//   instances with the same length and cutoff
+// - the FFT work area is shared by all the instances running on a thread,
+//   so the output pointers are only valid until the next block completes
+//   on the same thread
+//----------------------------------------------------------------------
+
+class fftfilt_fsk {
+public:
+	typedef std::complex<float> cmplxf;
+
+	fftfilt_fsk(double f, int len, double mark_f, double space_f,
+				double samplerate, int decimation = 1);
+	~fftfilt_fsk();
+
+	int run(double in, cmplxf **mark_out, cmplxf **space_out);
+	int get_decimation() const { return decimation; }
+	size_t footprint() const;
+
+private:
+	struct shared_response;
+	std::shared_ptr<shared_response> shared;
+	static std::shared_ptr<shared_response> get_shared(double f, int len,
+													   int decimation);
+
+	int flen;
+	int flen2;
+	int decimation;
+	int dlen2;
+	int inptr;
+	int pass;
+	double mark_phase;
+	double space_phase;
+	double mark_step;
+	double space_step;
+	float *timedata;
+	cmplxf *mark_ovlbuf;
+	cmplxf *space_ovlbuf;
+
+	void filter_block(double & phase, double step, cmplxf *work,
+					  cmplxf *ovlbuf);
+
+	fftfilt_fsk(const fftfilt_fsk &) = delete;
+	fftfilt_fsk & operator=(const fftfilt_fsk &) = delete;
 };
 
 #endif
@@ -137,6 +137,13 @@ public:
 	void InverseRealFFT(std::complex<FFT_TYPE> *buf);
 	FFT_TYPE GetInverseComplexFFTScale();
 	FFT_TYPE GetInverseRealFFTScale();
+
+// memory used by this instance, including its cosine and bit reverse tables
+	size_t footprint() const {
+		return sizeof(*this) +
+			(POW2(FFT_N) / 4 + 1) * sizeof(FFT_TYPE) +
+			(POW2(FFT_N / 2 - 1) + POW2((FFT_N - 1) / 2 - 1)) * sizeof(short);
+	}
 };
 
 //------------------------------------------------------------------------------
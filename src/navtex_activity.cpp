@@ -0,0 +1,143 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_activity.h"
+#include "navtex_rx.h"
+#include <algorithm>
+#include <cmath>
+
+static const int deviation_f = 85;
+
+// Reference frequencies, as offsets from the center frequency; they are
+// clear of the mark and space tones and of their keying sidebands
+static const double reference_offsets[] = { -500, -400, -300, 300, 400, 500 };
+
+// The ratio of the recording's noise is estimated as this percentile of
+// the block ratios, but no higher than max_noise_ratio, so that a
+// recording with a signal from start to end is not taken for noise
+static const double noise_percentile = 0.2;
+static const double max_noise_ratio = 2.0;
+
+activity_scanner::activity_scanner(int sample_rate, double center_frequency) {
+    threshold = 2.0;
+    // The decoder keeps decoding noise for a while after a signal ends, and
+    // its state at the start of a signal depends on the noise before it:
+    // with shorter margins the characters decoded at the edges of the
+    // transmissions can differ from a full decode.
+    pre_margin = 20.0;
+    post_margin = 20.0;
+
+    m_sample_rate = sample_rate;
+    // two bits at 100 baud
+    m_goertzel_len = sample_rate / 50;
+    // about half a second
+    m_block_size = (long long) m_goertzel_len * 25;
+
+    double freqs[nb_freqs];
+    freqs[0] = center_frequency + deviation_f;
+    freqs[1] = center_frequency - deviation_f;
+    for (int k = 2; k < nb_freqs; k++)
+        freqs[k] = center_frequency + reference_offsets[k - 2];
+    for (int k = 0; k < nb_freqs; k++)
+        m_coeffs[k] = 2.0 * cos(2.0 * M_PI * freqs[k] / sample_rate);
+}
+
+// Goertzel power at all the frequencies over m_goertzel_len samples.
+// The inner loop runs across the frequencies, so that the compiler can
+// vectorise it.
+void activity_scanner::goertzel(const short * data, float * power) const {
+    float s1[nb_freqs] = { 0 }, s2[nb_freqs] = { 0 };
+    for (int i = 0; i < m_goertzel_len; i++) {
+        float x = data[i];
+        for (int k = 0; k < nb_freqs; k++) {
+            float s0 = x + m_coeffs[k] * s1[k] - s2[k];
+            s2[k] = s1[k];
+            s1[k] = s0;
+        }
+    }
+    for (int k = 0; k < nb_freqs; k++)
+        power[k] = s1[k] * s1[k] + s2[k] * s2[k] - m_coeffs[k] * s1[k] * s2[k];
+}
+
+float activity_scanner::ratio(const short * data, long long nb_samples) const {
+    double tones = 0, refs = 0;
+    for (long long i = 0; i + m_goertzel_len <= nb_samples; i += m_goertzel_len) {
+        float power[nb_freqs];
+        goertzel(data + i, power);
+        tones += power[0] + power[1];
+        for (int k = 2; k < nb_freqs; k++)
+            refs += power[k];
+    }
+    // per frequency averages
+    tones /= 2;
+    refs /= nb_freqs - 2;
+    return refs > 0 ? tones / refs : (tones > 0 ? HUGE_VALF : 0);
+}
+
+std::vector<float> activity_scanner::block_ratios(const short * data,
+                                                  long long nb_samples) const {
+    std::vector<float> ratios;
+    ratios.reserve(nb_samples / m_block_size + 1);
+    for (long long block = 0; block < nb_samples; block += m_block_size)
+        ratios.push_back(ratio(data + block, std::min(m_block_size, nb_samples - block)));
+    return ratios;
+}
+
+std::vector<activity_region> activity_scanner::scan(const short * data,
+                                                    long long nb_samples) const {
+    std::vector<activity_region> regions;
+    std::vector<float> ratios = block_ratios(data, nb_samples);
+    if (ratios.empty())
+        return regions;
+
+    std::vector<float> sorted(ratios);
+    size_t nth = sorted.size() * noise_percentile;
+    std::nth_element(sorted.begin(), sorted.begin() + nth, sorted.end());
+    double noise_ratio = std::min((double) sorted[nth], max_noise_ratio);
+    double active_ratio = noise_ratio * threshold;
+
+    long long pre = pre_margin * m_sample_rate;
+    long long post = post_margin * m_sample_rate;
+    for (size_t b = 0; b < ratios.size(); b++) {
+        if (ratios[b] <= active_ratio)
+            continue;
+        long long start = std::max(0LL, (long long) b * m_block_size - pre);
+        long long end = std::min(nb_samples, (long long) (b + 1) * m_block_size + post);
+        if (!regions.empty() && start <= regions.back().end)
+            regions.back().end = std::max(regions.back().end, end);
+        else
+            regions.push_back({ start, end });
+    }
+    return regions;
+}
+
+void decode_regions(navtex_rx & rx, const short * data,
+                    const std::vector<activity_region> & regions,
+                    int block_size) {
+    long long position = rx.samples_in();
+    for (const activity_region & region : regions) {
+        if (region.end <= position)
+            continue;
+        rx.skip_samples(std::max(0LL, region.start - position));
+        for (position = std::max(position, region.start); position < region.end; position += block_size) {
+            int n = std::min((long long) block_size, region.end - position);
+            rx.process_data(data + position, n);
+        }
+        position = region.end;
+    }
+}
+
+std::vector<activity_region> clip_regions(const std::vector<activity_region> & regions,
+                                          long long start, long long end) {
+    std::vector<activity_region> clipped;
+    for (const activity_region & region : regions) {
+        activity_region r = { std::max(region.start, start), std::min(region.end, end) };
+        if (r.start < r.end)
+            clipped.push_back(r);
+    }
+    return clipped;
+}
@@ -0,0 +1,76 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_ACTIVITY_H
+#define _NAVTEX_ACTIVITY_H
+
+#include <vector>
+
+class navtex_rx;
+
+// A region of a recording, in samples
+struct activity_region {
+    long long start;    // first sample
+    long long end;      // one past the last sample
+};
+
+// Cheap search for the regions of a recording where a NAVTEX signal may
+// be present, so that offline replay can skip the band noise in between.
+//
+// The power at the mark and space tones is measured with Goertzel filters
+// on blocks two bits long, and compared with the power at reference
+// frequencies on both sides of the signal; all the frequencies are
+// computed together in one pass over the samples. Blocks whose ratio is
+// well above the typical (noise) ratio of the recording are active.
+class activity_scanner {
+public:
+    activity_scanner(int sample_rate, double center_frequency = 1000.0);
+
+    // Active regions of data, extended by the warm-up margins, merged
+    // when they overlap and clipped to [0, nb_samples)
+    std::vector<activity_region> scan(const short * data,
+                                      long long nb_samples) const;
+
+    // ratio of the power at the tones to the power at the references,
+    // for each scan block of data
+    std::vector<float> block_ratios(const short * data,
+                                    long long nb_samples) const;
+
+    // the same ratio, over all of data
+    float ratio(const short * data, long long nb_samples) const;
+
+    long long block_size() const { return m_block_size; }
+
+    // active when the ratio exceeds threshold times the noise ratio
+    double threshold;
+    // signal before and after each active region given to the decoder,
+    // so that its filters and trackers settle (seconds)
+    double pre_margin;
+    double post_margin;
+
+private:
+    static const int nb_freqs = 8;
+    int m_sample_rate;
+    int m_goertzel_len;
+    long long m_block_size;
+    float m_coeffs[nb_freqs];
+
+    void goertzel(const short * data, float * power) const;
+}; // activity_scanner
+
+// Decode only the given regions of data (sorted, not overlapping), and
+// skip the samples in between; regions before the current position of
+// the decoder are ignored
+void decode_regions(navtex_rx & rx, const short * data,
+                    const std::vector<activity_region> & regions,
+                    int block_size = 8192);
+
+// The parts of regions that are within [start, end)
+std::vector<activity_region> clip_regions(const std::vector<activity_region> & regions,
+                                          long long start, long long end);
+
+#endif /* _NAVTEX_ACTIVITY_H */
@@ -0,0 +1,101 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// build the sidecar activity index of a NAVTEX recording (signed LE16)
+// the index is written to <file>.idx unless another path is given
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "navtex_index.h"
+#include "navtex_recording.h"
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate file\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -o, --output=IDX  write the index to IDX instead of <file>.idx\n");
+    fprintf(stderr, "  -r, --reverse     reverse mark and space\n");
+    fprintf(stderr, "  -h, --help        show this help\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char * output = nullptr;
+    bool reverse = false;
+
+    static const struct option long_options[] = {
+        { "output",  required_argument, nullptr, 'o' },
+        { "reverse", no_argument,       nullptr, 'r' },
+        { "help",    no_argument,       nullptr, 'h' },
+        { nullptr,   0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:rh", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'o':
+            output = optarg;
+            break;
+        case 'r':
+            reverse = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int sample_rate;
+    if (sscanf(argv[optind], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    const char * path = argv[optind + 1];
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "open(%s) failed: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    mapped_recording recording;
+    if (!recording.map(fd)) {
+        fprintf(stderr, "cannot map %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    recording_index index;
+    index.build(recording.data(), recording.nb_samples(), sample_rate, reverse);
+
+    std::string index_path = output ? output : recording_index::sidecar_path(path);
+    if (!index.save(index_path)) {
+        fprintf(stderr, "cannot write %s: %s\n", index_path.c_str(), strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    long long active = 0;
+    for (const activity_region & r : index.activity)
+        active += r.end - r.start;
+    fprintf(stderr, "%s: %zu activity regions (%.1f%% of %.0f s), %zu sync intervals, %zu headers\n",
+            index_path.c_str(), index.activity.size(),
+            100.0 * active / recording.nb_samples(),
+            (double) recording.nb_samples() / sample_rate,
+            index.sync.size(), index.headers.size());
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,238 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_bus.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[8] = { 'N', 'A', 'V', 'T', 'E', 'X', 'M', 'B' };
+static const uint32_t version = 1;
+
+// The *_start counters are stored before a message is written, and the
+// *_end counters after (see shm_ring_header in navtex_shm.cpp)
+struct message_bus_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t nb_records;
+    uint64_t arena_size;
+    alignas(64) std::atomic<uint64_t> records_start;
+    std::atomic<uint64_t> records_end;
+    std::atomic<uint64_t> arena_start;
+    std::atomic<uint64_t> arena_end;
+    std::atomic<uint32_t> closed;
+};
+
+static const size_t records_offset = (sizeof(message_bus_header) + 63) & ~(size_t) 63;
+
+static uint64_t round_up_pow2(long long n) {
+    uint64_t size = 1;
+    while ((long long) size < n)
+        size <<= 1;
+    return size;
+}
+
+// shm_open() wants names starting with a slash
+static std::string shm_name(const std::string & name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+
+message_bus_writer::message_bus_writer() :
+    m_header(nullptr),
+    m_records(nullptr),
+    m_arena(nullptr),
+    m_size(0) {
+}
+
+message_bus_writer::~message_bus_writer() {
+    if (m_header != nullptr)
+        munmap(m_header, m_size);
+}
+
+bool message_bus_writer::create(const std::string & name, long long nb_records,
+                                long long arena_size) {
+    uint64_t records = round_up_pow2(nb_records);
+    uint64_t arena = round_up_pow2(arena_size);
+    m_name = shm_name(name);
+    m_size = records_offset + records * sizeof(bus_record) + arena;
+
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd == -1)
+        return false;
+    // start from a clean (zeroed) bus, even if the name was left behind
+    // by a previous writer
+    bool ok = ftruncate(fd, 0) == 0 && ftruncate(fd, m_size) == 0;
+    void * addr = ok ? mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+
+    m_header = new (addr) message_bus_header();
+    m_header->version = version;
+    m_header->record_size = sizeof(bus_record);
+    m_header->nb_records = records;
+    m_header->arena_size = arena;
+    m_records = reinterpret_cast<bus_record *>(static_cast<char *>(addr) + records_offset);
+    m_arena = reinterpret_cast<char *>(m_records + records);
+    // the magic goes last, so that a reader never sees a half built header
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_header->magic, magic, sizeof(magic));
+    return true;
+}
+
+void message_bus_writer::publish(uint32_t channel, char origin, char subject,
+                                 int number, long long sample,
+                                 const char * text, size_t text_length) {
+    uint64_t arena_size = m_header->arena_size;
+    uint64_t seq = m_header->records_end.load(std::memory_order_relaxed);
+    uint64_t offset = m_header->arena_end.load(std::memory_order_relaxed);
+    text_length = std::min(text_length, (size_t) arena_size);
+    // the text is contiguous in the arena: when it does not fit before
+    // the end, it goes at the start
+    uint64_t index = offset & (arena_size - 1);
+    if (index + text_length > arena_size)
+        offset += arena_size - index;
+    uint64_t text_end = offset + text_length;
+
+    m_header->records_start.store(seq + 1, std::memory_order_relaxed);
+    m_header->arena_start.store(text_end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(m_arena + (offset & (arena_size - 1)), text, text_length);
+    bus_record & record = m_records[seq & (m_header->nb_records - 1)];
+    record.seq = seq;
+    record.sample = sample;
+    record.time = time(nullptr);
+    record.text_offset = offset;
+    record.text_length = text_length;
+    record.channel = channel;
+    record.origin = origin;
+    record.subject = subject;
+    record.number = number;
+    record.reserved = 0;
+
+    m_header->arena_end.store(text_end, std::memory_order_relaxed);
+    m_header->records_end.store(seq + 1, std::memory_order_release);
+}
+
+void message_bus_writer::close() {
+    m_header->closed.store(1, std::memory_order_release);
+}
+
+void message_bus_writer::unlink() {
+    shm_unlink(m_name.c_str());
+}
+
+
+message_bus_reader::message_bus_reader() :
+    m_header(nullptr),
+    m_records(nullptr),
+    m_arena(nullptr),
+    m_size(0),
+    m_cursor(0),
+    m_text_offset(0),
+    m_lost(0) {
+}
+
+message_bus_reader::~message_bus_reader() {
+    if (m_header != nullptr)
+        munmap(const_cast<message_bus_header *>(m_header), m_size);
+}
+
+bool message_bus_reader::attach(const std::string & name, bool from_oldest) {
+    int fd = shm_open(shm_name(name).c_str(), O_RDONLY, 0);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    void * addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size > records_offset) {
+        m_size = st.st_size;
+        addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    m_header = static_cast<const message_bus_header *>(addr);
+    bool ok = memcmp(m_header->magic, magic, sizeof(magic)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    ok = ok && m_header->version == version &&
+         m_header->record_size == sizeof(bus_record) &&
+         records_offset + m_header->nb_records * sizeof(bus_record) +
+         m_header->arena_size == m_size;
+    if (!ok) {
+        munmap(addr, m_size);
+        m_header = nullptr;
+        return false;
+    }
+    m_records = reinterpret_cast<const bus_record *>(static_cast<const char *>(addr) +
+                                                     records_offset);
+    m_arena = reinterpret_cast<const char *>(m_records + m_header->nb_records);
+    if (from_oldest) {
+        uint64_t start = m_header->records_start.load(std::memory_order_acquire);
+        m_cursor = start > m_header->nb_records ? start - m_header->nb_records : 0;
+    } else {
+        m_cursor = m_header->records_end.load(std::memory_order_acquire);
+    }
+    m_lost = 0;
+    return true;
+}
+
+// Neither the record at the cursor nor its text have been overwritten
+bool message_bus_reader::still_valid() const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t records_start = m_header->records_start.load(std::memory_order_relaxed);
+    uint64_t arena_start = m_header->arena_start.load(std::memory_order_relaxed);
+    return records_start <= m_cursor + m_header->nb_records &&
+           arena_start <= m_text_offset + m_header->arena_size;
+}
+
+bool message_bus_reader::peek(bus_record & record, const char ** text) {
+    for (;;) {
+        uint64_t end = m_header->records_end.load(std::memory_order_acquire);
+        if (m_cursor >= end)
+            return false;
+        uint64_t start = m_header->records_start.load(std::memory_order_relaxed);
+        if (m_cursor + m_header->nb_records < start) {
+            m_lost += start - m_header->nb_records - m_cursor;
+            m_cursor = start - m_header->nb_records;
+        }
+        record = m_records[m_cursor & (m_header->nb_records - 1)];
+        m_text_offset = record.text_offset;
+        if (record.seq == m_cursor && still_valid()) {
+            *text = m_arena + (record.text_offset & (m_header->arena_size - 1));
+            return true;
+        }
+        // lapped by the writer
+        m_lost++;
+        m_cursor++;
+    }
+}
+
+bool message_bus_reader::consume() {
+    bool ok = still_valid();
+    if (!ok)
+        m_lost++;
+    m_cursor++;
+    return ok;
+}
+
+bool message_bus_reader::finished() const {
+    return m_header->closed.load(std::memory_order_acquire) &&
+           m_cursor >= m_header->records_end.load(std::memory_order_acquire);
+}
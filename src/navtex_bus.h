@@ -0,0 +1,105 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_BUS_H
+#define _NAVTEX_BUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct message_bus_header;
+
+// A decoded message, as delivered on the bus
+struct bus_record {
+    uint64_t seq;               // position of the message on the bus
+    int64_t sample;             // decoder sample count when it was saved
+    int64_t time;               // wall clock time when it was published
+    uint64_t text_offset;       // position of the text in the arena stream
+    uint32_t text_length;
+    uint32_t channel;           // which decoder saved it
+    char origin;                // B1 ('?' if unknown)
+    char subject;               // B2 ('?' if unknown)
+    uint16_t number;            // B3B4
+    uint32_t reserved;
+};
+
+// Message bus in POSIX shared memory: decoders publish the messages they
+// save, and any number of local processes (alerting, archiving, display)
+// read them without parsing text and without locks.
+//
+// The bus is a header, a power of two number of fixed size records, and
+// a power of two byte arena with the text of the messages. Like the
+// capture ring (navtex_shm.h), the writer never waits for the readers:
+// it marks what it is about to overwrite before writing, and the readers
+// check afterwards whether what they read is still valid.
+class message_bus_writer {
+public:
+    message_bus_writer();
+    ~message_bus_writer();
+    message_bus_writer(const message_bus_writer &) = delete;
+    message_bus_writer & operator=(const message_bus_writer &) = delete;
+
+    // Create the bus /name, with room for at least nb_records messages
+    // and arena_size bytes of text
+    bool create(const std::string & name, long long nb_records,
+                long long arena_size);
+    // A copy of the text into the arena, a copy of the record, and an
+    // atomic store, whatever the number of readers; not thread safe
+    // (decoders on different threads must share the writer under a lock)
+    void publish(uint32_t channel, char origin, char subject, int number,
+                 long long sample, const char * text, size_t text_length);
+    // Tell the readers that no more messages will come
+    void close();
+    // Remove the name (the readers that have it mapped keep it)
+    void unlink();
+
+private:
+    std::string m_name;
+    message_bus_header * m_header;
+    bus_record * m_records;
+    char * m_arena;
+    size_t m_size;
+}; // message_bus_writer
+
+// Consumer side of the bus
+class message_bus_reader {
+public:
+    message_bus_reader();
+    ~message_bus_reader();
+    message_bus_reader(const message_bus_reader &) = delete;
+    message_bus_reader & operator=(const message_bus_reader &) = delete;
+
+    // Attach to the bus /name; reading starts with the next message
+    // published, or with the oldest message still on the bus
+    bool attach(const std::string & name, bool from_oldest = false);
+
+    // The next message, if there is one: record is a copy, and text
+    // points into the arena (it is not NUL terminated)
+    bool peek(bus_record & record, const char ** text);
+    // Done with the message returned by peek(); returns false if the
+    // writer may have overwritten it in the meantime (it is counted in
+    // lost())
+    bool consume();
+    // the writer has closed the bus and all the messages have been read
+    bool finished() const;
+    // messages lost because the writer lapped the reader
+    long long lost() const { return m_lost; }
+
+private:
+    const message_bus_header * m_header;
+    const bus_record * m_records;
+    const char * m_arena;
+    size_t m_size;
+    uint64_t m_cursor;
+    uint64_t m_text_offset;
+    long long m_lost;
+
+    bool still_valid() const;
+}; // message_bus_reader
+
+#endif /* _NAVTEX_BUS_H */
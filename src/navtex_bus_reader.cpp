@@ -0,0 +1,96 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// print the messages published on a shared memory message bus by
+// 'navtex_rx_from_file --bus', as they come; an example of a consumer
+// of the bus
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <getopt.h>
+#include <unistd.h>
+#include "navtex_bus.h"
+
+// how often to look for new messages (us)
+constexpr int poll_interval = 100000;
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] name\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -a, --all   start with the oldest message still on the bus, instead of\n");
+    fprintf(stderr, "              the next one\n");
+    fprintf(stderr, "  -h, --help  show this help\n");
+}
+
+int main(int argc, char** argv)
+{
+    bool from_oldest = false;
+
+    static const struct option long_options[] = {
+        { "all",  no_argument, nullptr, 'a' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0,          nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "ah", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'a':
+            from_oldest = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char * name = argv[optind];
+
+    message_bus_reader bus;
+    if (!bus.attach(name, from_oldest)) {
+        fprintf(stderr, "cannot attach to the message bus %s: %s\n", name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    long long lost = 0;
+    while (!bus.finished()) {
+        bus_record record;
+        const char * text;
+        if (!bus.peek(record, &text)) {
+            usleep(poll_interval);
+            continue;
+        }
+        char timestamp[32];
+        time_t t = record.time;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        printf("--- %s channel %u %c%c%02u sample %lld\n", timestamp,
+               record.channel, record.origin, record.subject, record.number,
+               (long long) record.sample);
+        fwrite(text, 1, record.text_length, stdout);
+        putchar('\n');
+        if (!bus.consume())
+            fprintf(stderr, "the message above was overwritten while it was printed\n");
+        if (bus.lost() != lost) {
+            fprintf(stderr, "%lld messages lost\n", bus.lost() - lost);
+            lost = bus.lost();
+        }
+        fflush(stdout);
+    }
+
+    return 0;
+}
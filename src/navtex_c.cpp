@@ -0,0 +1,188 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// C API for the NAVTEX decoder (see navtex_c.h)
+
+#include "navtex_c.h"
+#include "navtex_rx.h"
+#include <climits>
+#include <new>
+#include <vector>
+
+namespace {
+
+// navtex_rx that queues what it decodes as events, instead of writing it
+// to files
+class event_rx : public navtex_rx {
+public:
+    explicit event_rx(const navtex_config & config);
+    void start_batch();
+    size_t pending() const { return m_events.size() - m_next_event; }
+    size_t get_events(navtex_event * events, size_t max_events);
+
+protected:
+    void put_rx_char(int c) override;
+    void put_received_message(const ccir_message & ccir_msg,
+                              const std::string & message) override;
+
+private:
+    // the text of the queued events is kept as offsets into m_text,
+    // and turned into pointers when the events are retrieved, because
+    // m_text may move while it grows
+    std::vector<navtex_event> m_events;
+    std::vector<size_t> m_text_offsets;
+    size_t m_next_event;
+    std::string m_text;
+
+    void queue_event(navtex_event_type type, const char * text, size_t len);
+};
+
+event_rx::event_rx(const navtex_config & config) :
+    navtex_rx(config.sample_rate, config.only_sitor_b, config.reverse,
+              nullptr, nullptr, nullptr, config.compact),
+    m_next_event(0)
+{
+    m_events.reserve(256);
+    m_text_offsets.reserve(256);
+    m_text.reserve(4096);
+}
+
+// Text returned by the previous batch is released only once all its
+// events have been retrieved
+void event_rx::start_batch() {
+    if (m_next_event < m_events.size())
+        return;
+    m_events.clear();
+    m_text_offsets.clear();
+    m_next_event = 0;
+    m_text.clear();
+}
+
+size_t event_rx::get_events(navtex_event * events, size_t max_events) {
+    size_t n = 0;
+    for (; n < max_events && m_next_event < m_events.size(); n++, m_next_event++) {
+        events[n] = m_events[m_next_event];
+        events[n].text = m_text.data() + m_text_offsets[m_next_event];
+    }
+    return n;
+}
+
+void event_rx::queue_event(navtex_event_type type, const char * text, size_t len) {
+    navtex_event event;
+    event.type = type;
+    event.origin = '?';
+    event.subject = '?';
+    event.number = 0;
+    event.sample = sample_count();
+    event.text = nullptr;
+    event.text_length = len;
+    m_events.push_back(event);
+    m_text_offsets.push_back(m_text.size());
+    m_text.append(text, len);
+}
+
+void event_rx::put_rx_char(int c) {
+    char ch = c;
+    // consecutive characters are coalesced into one event
+    if (m_next_event < m_events.size()) {
+        navtex_event & last = m_events.back();
+        if (last.type == NAVTEX_EVENT_TEXT &&
+            m_text_offsets.back() + last.text_length == m_text.size()) {
+            m_text.push_back(ch);
+            last.text_length++;
+            return;
+        }
+    }
+    queue_event(NAVTEX_EVENT_TEXT, &ch, 1);
+}
+
+void event_rx::put_received_message(const ccir_message & ccir_msg,
+                                    const std::string & message) {
+    queue_event(NAVTEX_EVENT_MESSAGE, message.data(), message.size());
+    navtex_event & event = m_events.back();
+    event.origin = ccir_msg.origin();
+    event.subject = ccir_msg.subject();
+    event.number = ccir_msg.number();
+}
+
+} // namespace
+
+struct navtex_handle {
+    event_rx rx;
+    explicit navtex_handle(const navtex_config & config) : rx(config) {}
+};
+
+
+extern "C" {
+
+unsigned navtex_api_version(void) {
+    return NAVTEX_API_VERSION;
+}
+
+void navtex_config_init(navtex_config * config) {
+    config->struct_size = sizeof(navtex_config);
+    config->sample_rate = 11025;
+    config->only_sitor_b = 0;
+    config->reverse = 0;
+    config->compact = 0;
+}
+
+navtex_handle * navtex_create(const navtex_config * config) {
+    if (config == nullptr || config->struct_size != sizeof(navtex_config) ||
+        config->sample_rate <= 0)
+        return nullptr;
+    try {
+        return new navtex_handle(*config);
+    } catch (const std::exception &) {
+        return nullptr;
+    }
+}
+
+void navtex_destroy(navtex_handle * handle) {
+    delete handle;
+}
+
+int navtex_process(navtex_handle * handle, const void * buf, size_t nb_samples,
+                   navtex_format format) {
+    if (handle == nullptr || (buf == nullptr && nb_samples > 0))
+        return NAVTEX_ERR_INVALID;
+    if (format != NAVTEX_FORMAT_S16 && format != NAVTEX_FORMAT_F32)
+        return NAVTEX_ERR_INVALID;
+    try {
+        handle->rx.start_batch();
+        while (nb_samples > 0) {
+            int n = nb_samples > INT_MAX ? INT_MAX : nb_samples;
+            if (format == NAVTEX_FORMAT_S16) {
+                handle->rx.process_data(static_cast<const short *>(buf), n);
+                buf = static_cast<const short *>(buf) + n;
+            } else {
+                handle->rx.process_data(static_cast<const float *>(buf), n);
+                buf = static_cast<const float *>(buf) + n;
+            }
+            nb_samples -= n;
+        }
+    } catch (const std::bad_alloc &) {
+        return NAVTEX_ERR_NOMEM;
+    }
+    size_t pending = handle->rx.pending();
+    return pending > INT_MAX ? INT_MAX : pending;
+}
+
+size_t navtex_get_events(navtex_handle * handle, navtex_event * events,
+                         size_t max_events) {
+    if (handle == nullptr || events == nullptr)
+        return 0;
+    return handle->rx.get_events(events, max_events);
+}
+
+size_t navtex_footprint(const navtex_handle * handle) {
+    if (handle == nullptr)
+        return 0;
+    return handle->rx.footprint();
+}
+
+} // extern "C"
@@ -0,0 +1,107 @@
+/* -*- c -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * C API for the NAVTEX decoder, for embedding from other languages
+ *
+ * Samples are passed in batches, and the decoded text comes back as
+ * batches of fixed layout events; the text of the events points into a
+ * buffer owned by the decoder, so nothing is copied on the way out.
+ *
+ * Typical use:
+ *
+ *     navtex_config config;
+ *     navtex_config_init(&config);
+ *     config.sample_rate = 11025;
+ *     navtex_handle * h = navtex_create(&config);
+ *     while (... more samples ...) {
+ *         navtex_process(h, buf, nb_samples, NAVTEX_FORMAT_S16);
+ *         navtex_event events[64];
+ *         size_t n;
+ *         while ((n = navtex_get_events(h, events, 64)) > 0)
+ *             ... use events[0..n) ...
+ *     }
+ *     navtex_destroy(h);
+ */
+
+#ifndef _NAVTEX_C_H
+#define _NAVTEX_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Incremented whenever the API or the layout of the structures changes */
+#define NAVTEX_API_VERSION 1
+
+typedef struct navtex_handle navtex_handle;
+
+typedef enum {
+    NAVTEX_FORMAT_S16 = 0,      /* signed 16 bit samples, native endianness */
+    NAVTEX_FORMAT_F32 = 1       /* float samples in [-1, 1] */
+} navtex_format;
+
+typedef enum {
+    NAVTEX_EVENT_TEXT = 1,      /* characters as they are received */
+    NAVTEX_EVENT_MESSAGE = 2    /* a complete message */
+} navtex_event_type;
+
+/* Return codes (negative values are errors) */
+#define NAVTEX_OK 0
+#define NAVTEX_ERR_INVALID -1
+#define NAVTEX_ERR_NOMEM -2
+
+typedef struct {
+    uint32_t struct_size;       /* sizeof(navtex_config) */
+    int32_t sample_rate;
+    int32_t only_sitor_b;
+    int32_t reverse;
+    int32_t compact;            /* small memory footprint per decoder */
+} navtex_config;
+
+typedef struct {
+    uint32_t type;              /* navtex_event_type */
+    char origin;                /* B1 ('?' if unknown), messages only */
+    char subject;               /* B2 ('?' if unknown), messages only */
+    uint16_t number;            /* B3B4, messages only */
+    int64_t sample;             /* decoder sample count at the event */
+    /* Text of the event (not NUL terminated); it remains valid until the
+       next call to navtex_process() or navtex_destroy() */
+    const char * text;
+    size_t text_length;
+} navtex_event;
+
+/* Version the library was built with (NAVTEX_API_VERSION) */
+unsigned navtex_api_version(void);
+
+void navtex_config_init(navtex_config * config);
+
+/* Returns NULL if the configuration is invalid */
+navtex_handle * navtex_create(const navtex_config * config);
+void navtex_destroy(navtex_handle * handle);
+
+/* Decode nb_samples samples from buf; returns the number of events
+   waiting to be retrieved, or a negative error code */
+int navtex_process(navtex_handle * handle, const void * buf, size_t nb_samples,
+                   navtex_format format);
+
+/* Move up to max_events pending events to events; returns how many were
+   moved (0 when there are none left) */
+size_t navtex_get_events(navtex_handle * handle, navtex_event * events,
+                         size_t max_events);
+
+/* Bytes of memory used by the decoder */
+size_t navtex_footprint(const navtex_handle * handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NAVTEX_C_H */
@@ -0,0 +1,195 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_clip.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+clip_recorder::clip_recorder(int sample_rate, bool only_sitor_b, bool reverse,
+                             const std::string & directory, double pre_trigger,
+                             bool trigger_on_sync, FILE * rawfile,
+                             FILE * messagesfile, FILE * logfile, bool compact) :
+    navtex_rx(sample_rate, only_sitor_b, reverse, rawfile, messagesfile,
+              logfile, compact),
+    post_trigger(1.0),
+    max_clip_length(660.0),
+    m_directory(directory),
+    m_trigger_on_sync(trigger_on_sync),
+    m_start_time(time(nullptr)),
+    m_sample_rate(sample_rate),
+    m_ring(std::max(1L, (long) (pre_trigger * sample_rate))),
+    m_ring_end(0),
+    m_ring_fill(0),
+    m_clip(nullptr),
+    m_clip_start(0),
+    m_clip_written(0),
+    m_clip_end(0)
+{
+    m_clip_name[0] = '\0';
+}
+
+clip_recorder::~clip_recorder()
+{
+    if (m_clip != nullptr)
+        close_clip();
+}
+
+void clip_recorder::finish()
+{
+    navtex_rx::finish();
+    if (m_clip != nullptr)
+        close_clip();
+}
+
+// The clip is written to a temporary file, and renamed when it is closed,
+// because its name depends on the header, which may come after the
+// trigger.
+void clip_recorder::start_clip(long long trigger)
+{
+    long long block_start = samples_in();
+    long long available = m_ring_end == block_start ? m_ring_fill : 0;
+    long long start = trigger - (long long) m_ring.size();
+    start = std::min(std::max(start, block_start - available), block_start);
+
+    time_t t = m_start_time + start / m_sample_rate;
+    struct tm tm;
+    char timestamp[32];
+    gmtime_r(&t, &tm);
+    strftime(timestamp, sizeof(timestamp), "%Y%m%dT%H%M%SZ", &tm);
+    m_clip_tmp_path = m_directory + "/." + timestamp + ".part";
+    m_clip = fopen(m_clip_tmp_path.c_str(), "wb");
+    if (m_clip == nullptr) {
+        fprintf(stderr, "cannot create clip %s: %s\n", m_clip_tmp_path.c_str(),
+                strerror(errno));
+        return;
+    }
+    strcpy(m_clip_name, "none");
+    m_clip_start = start;
+    m_clip_written = start;
+    m_clip_end = start + (long long) (max_clip_length * m_sample_rate);
+    write_ring(start);
+}
+
+void clip_recorder::close_clip()
+{
+    fclose(m_clip);
+    m_clip = nullptr;
+    // .<timestamp>.part -> <name>-<timestamp>.raw
+    size_t slash = m_clip_tmp_path.rfind('/');
+    std::string timestamp = m_clip_tmp_path.substr(slash + 2,
+        m_clip_tmp_path.size() - slash - 2 - strlen(".part"));
+    std::string path = m_directory + "/" + m_clip_name + "-" + timestamp + ".raw";
+    if (rename(m_clip_tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "cannot rename clip %s: %s\n", m_clip_tmp_path.c_str(),
+                strerror(errno));
+        path = m_clip_tmp_path;
+    }
+    m_clips.push_back(path);
+}
+
+// Write the samples of the pre-trigger buffer from position from onwards
+void clip_recorder::write_ring(long long from)
+{
+    long long size = m_ring.size();
+    for (long long pos = from; pos < m_ring_end; ) {
+        long long index = pos % size;
+        long long n = std::min(m_ring_end - pos, size - index);
+        fwrite(m_ring.data() + index, sizeof(short), n, m_clip);
+        pos += n;
+    }
+    m_clip_written = std::max(m_clip_written, m_ring_end);
+}
+
+// Write the part of the block just processed that belongs to the clip
+void clip_recorder::write_block(const short * data, int nb_samples)
+{
+    long long block_end = samples_in();
+    long long block_start = block_end - nb_samples;
+    // nothing is recorded for the samples skipped by the decoder
+    if (m_clip_written < block_start)
+        m_clip_written = block_start;
+    long long end = std::min(m_clip_end, block_end);
+    if (end > m_clip_written) {
+        fwrite(data + (m_clip_written - block_start), sizeof(short),
+               end - m_clip_written, m_clip);
+        m_clip_written = end;
+    }
+    if (m_clip_written >= m_clip_end)
+        close_clip();
+}
+
+void clip_recorder::push_ring(const short * data, int nb_samples)
+{
+    long long size = m_ring.size();
+    long long block_start = samples_in() - nb_samples;
+    if (m_ring_end != block_start)
+        m_ring_fill = 0;
+    long long n = std::min((long long) nb_samples, size);
+    for (long long pos = samples_in() - n; pos < samples_in(); ) {
+        long long index = pos % size;
+        long long k = std::min(samples_in() - pos, size - index);
+        memcpy(m_ring.data() + index, data + (pos - block_start), k * sizeof(short));
+        pos += k;
+    }
+    m_ring_end = samples_in();
+    m_ring_fill = std::min(m_ring_fill + nb_samples, size);
+}
+
+void clip_recorder::data_processed(const short * data, int nb_samples)
+{
+    if (m_clip != nullptr)
+        write_block(data, nb_samples);
+    push_ring(data, nb_samples);
+}
+
+void clip_recorder::data_processed(const float * data, int nb_samples)
+{
+    m_convert_buf.resize(nb_samples);
+    for (int i = 0; i < nb_samples; i++)
+        m_convert_buf[i] = std::max(-32767.0f, std::min(32767.0f, 32767 * data[i]));
+    data_processed(m_convert_buf.data(), nb_samples);
+}
+
+// End of a message (NNNN, timeout, or a new header)
+void clip_recorder::put_received_message(const ccir_message & ccir_msg,
+                                         const std::string & message)
+{
+    navtex_rx::put_received_message(ccir_msg, message);
+    if (m_clip != nullptr)
+        m_clip_end = std::min(m_clip_end, input_position() +
+                              (long long) (post_trigger * m_sample_rate));
+}
+
+void clip_recorder::sync_changed(bool locked)
+{
+    if (!m_trigger_on_sync)
+        return;
+    if (locked && m_clip == nullptr)
+        start_clip(input_position());
+    // a lock that did not produce a header
+    else if (!locked && m_clip != nullptr && strcmp(m_clip_name, "none") == 0)
+        m_clip_end = std::min(m_clip_end, input_position() +
+                              (long long) (post_trigger * m_sample_rate));
+}
+
+void clip_recorder::header_detected(const ccir_message & header)
+{
+    // a clip started on sync takes the name of its header (any text
+    // received before the header ended it just now)
+    if (m_clip != nullptr && strcmp(m_clip_name, "none") == 0) {
+        m_clip_end = m_clip_start + (long long) (max_clip_length * m_sample_rate);
+    } else {
+        if (m_clip != nullptr)
+            close_clip();
+        start_clip(input_position());
+        if (m_clip == nullptr)
+            return;
+    }
+    snprintf(m_clip_name, sizeof(m_clip_name), "%c%c%02u",
+             header.origin(), header.subject(), (unsigned) header.number() % 100);
+}
@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_CLIP_H
+#define _NAVTEX_CLIP_H
+
+#include "navtex_rx.h"
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// navtex_rx that saves the audio around each message it decodes, so that
+// the messages can be listened to again without keeping the whole
+// recording.
+//
+// The last pre_trigger seconds of input are kept in a circular buffer.
+// When a ZCZC header is recognised (or, with trigger_on_sync, when the
+// decoder locks on a signal) a clip starts with the content of the
+// buffer, and it ends post_trigger seconds after the end of the message
+// (NNNN, timeout, or the next header).  Clips are signed 16 bit raw files
+// named after the message and the time of the trigger, for instance
+// <directory>/IA76-20201018T101500Z.raw (none-<time>.raw for a clip
+// without a header).
+class clip_recorder : public navtex_rx {
+public:
+    clip_recorder(int sample_rate, bool only_sitor_b, bool reverse,
+                  const std::string & directory, double pre_trigger = 5.0,
+                  bool trigger_on_sync = false,
+                  FILE * rawfile=stdout, FILE * messagesfile=nullptr,
+                  FILE * logfile=stderr, bool compact=false);
+    ~clip_recorder() override;
+
+    // Wall clock time of the first input sample, used to timestamp the
+    // clips; the time the recorder was created by default
+    void set_start_time(time_t start_time) { m_start_time = start_time; }
+    // End of the input: close the clip being recorded, if any
+    void finish() override;
+    // paths of the clips saved so far
+    const std::vector<std::string> & clips() const { return m_clips; }
+
+    // seconds of audio after the end of a message
+    double post_trigger;
+    // longest clip, in seconds (a message without an end is cut here)
+    double max_clip_length;
+
+protected:
+    void put_received_message(const ccir_message & ccir_msg,
+                              const std::string & message) override;
+    void sync_changed(bool locked) override;
+    void header_detected(const ccir_message & header) override;
+    void data_processed(const short * data, int nb_samples) override;
+    void data_processed(const float * data, int nb_samples) override;
+
+private:
+    std::string m_directory;
+    bool m_trigger_on_sync;
+    time_t m_start_time;
+    int m_sample_rate;
+
+    // circular pre-trigger buffer, holding the input samples up to
+    // m_ring_end
+    std::vector<short> m_ring;
+    long long m_ring_end;
+    long long m_ring_fill;
+
+    // clip being recorded
+    FILE * m_clip;
+    std::string m_clip_tmp_path;
+    char m_clip_name[5];
+    long long m_clip_start;
+    long long m_clip_written;
+    long long m_clip_end;
+    std::vector<std::string> m_clips;
+    std::vector<short> m_convert_buf;
+
+    void start_clip(long long trigger);
+    void close_clip();
+    void write_ring(long long from);
+    void write_block(const short * data, int nb_samples);
+    void push_ring(const short * data, int nb_samples);
+}; // clip_recorder
+
+#endif /* _NAVTEX_CLIP_H */
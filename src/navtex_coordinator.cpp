@@ -0,0 +1,519 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// decoding coordinator: spreads the decoding of many channels (raw
+// recordings, signed LE16) over worker processes (navtex_worker), which
+// connect to its Unix domain socket, either started by the coordinator
+// or by hand (more workers can join at any time). The coordinator assigns
+// the channels, collects their messages (printed here, once each, even
+// when a channel is decoded again from a checkpoint) and statistics, and
+// moves the channels:
+// - when a worker goes away, its channels resume on the others from
+//   their last checkpoint (the start of the signal with text not
+//   delivered yet, or of the signal being decoded, or the position
+//   reached);
+// - every few seconds, a channel of the busiest worker is moved to the
+//   least busy one, from the checkpoint where it is stopped, when that
+//   makes them more even.
+// The workers only need to be able to read the recordings, so the
+// socket could be swapped for a network one to spread them over hosts.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "navtex_shard.h"
+
+constexpr int default_workers = 2;
+constexpr double default_rebalance = 5;
+// how long to wait for the workers started here before assigning the
+// channels, and for any worker when none is left
+constexpr double startup_timeout = 5;
+constexpr double orphan_timeout = 30;
+
+struct channel_state {
+    std::string path;
+    int worker;                 // -1: not assigned
+    int target;                 // where it goes once revoked (-1: none)
+    bool done;
+    bool failed;
+    long long checkpoint;       // where to resume the channel
+    long long position;         // where its decoding is
+    long long last_message;     // sample of the last message (-1: none)
+    double cpu_before;          // CPU time on the previous workers
+    double cpu;                 // on the current one
+    int messages;
+    int moves;
+};
+
+struct worker_state {
+    std::unique_ptr<shard_connection> connection;
+    int pid;                    // as said in hello (0 before)
+    bool alive;
+    double load;                // CPU used, as last reported
+    int done;                   // channels finished on it
+    int messages;
+};
+
+static double start_time;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void log_event(const char * format, ...) __attribute__((format(printf, 1, 2)));
+
+static void log_event(const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[%.1f s] ", now_seconds() - start_time);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate file...\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -s, --socket=PATH    socket of the coordinator\n");
+    fprintf(stderr, "                       (default: /tmp/navtex_coordinator.<pid>)\n");
+    fprintf(stderr, "  -w, --workers=N      workers to start (default: %d; 0: only the\n",
+            default_workers);
+    fprintf(stderr, "                       ones started by hand)\n");
+    fprintf(stderr, "  -W, --worker=PATH    worker program (default: navtex_worker next to\n");
+    fprintf(stderr, "                       this one)\n");
+    fprintf(stderr, "  -x, --speed=X        decode at X times real time (default: 0, as\n");
+    fprintf(stderr, "                       fast as possible)\n");
+    fprintf(stderr, "  -r, --rebalance=S    seconds between load rebalancing (default: %g;\n",
+            default_rebalance);
+    fprintf(stderr, "                       0: never)\n");
+    fprintf(stderr, "  -h, --help           show this help\n");
+}
+
+class coordinator {
+public:
+    coordinator(int sample_rate, double speed) :
+        m_sample_rate(sample_rate),
+        m_speed(speed) {}
+
+    void add_channel(const std::string & path) {
+        channel_state c = {};
+        c.path = path;
+        c.worker = -1;
+        c.target = -1;
+        c.last_message = -1;
+        m_channels.push_back(c);
+    }
+
+    int add_worker(int fd) {
+        worker_state w = {};
+        w.connection.reset(new shard_connection(fd));
+        m_workers.push_back(std::move(w));
+        return m_workers.size() - 1;
+    }
+
+    std::vector<worker_state> & workers() { return m_workers; }
+    int nb_alive() const {
+        return std::count_if(m_workers.begin(), m_workers.end(),
+                             [](const worker_state & w) { return w.alive; });
+    }
+    bool finished() const {
+        return std::all_of(m_channels.begin(), m_channels.end(),
+                           [](const channel_state & c) { return c.done; });
+    }
+
+    // Process what worker has sent; false when it has gone away
+    bool receive(int worker);
+    void worker_lost(int worker);
+    // Assign the channels waiting for a worker, each to the worker with
+    // the fewest channels
+    void assign_waiting();
+    void rebalance();
+    void report() const;
+
+private:
+    int m_sample_rate;
+    double m_speed;
+    std::vector<channel_state> m_channels;
+    std::vector<worker_state> m_workers;
+
+    int nb_channels(int worker) const {
+        return std::count_if(m_channels.begin(), m_channels.end(),
+                             [worker](const channel_state & c) { return c.worker == worker; });
+    }
+    void assign(int channel, int worker);
+    void handle(int worker, const std::vector<std::string> & fields,
+                const std::string & payload);
+};
+
+void coordinator::assign(int channel, int worker) {
+    channel_state & c = m_channels[channel];
+    c.worker = worker;
+    m_workers[worker].connection->send("assign " + std::to_string(channel) + " " +
+                                       std::to_string(m_sample_rate) + " " +
+                                       std::to_string(c.checkpoint) + " " +
+                                       std::to_string(m_speed) + " " + c.path);
+}
+
+void coordinator::assign_waiting() {
+    for (size_t i = 0; i < m_channels.size(); i++) {
+        channel_state & c = m_channels[i];
+        if (c.done || c.worker != -1)
+            continue;
+        int best = -1;
+        for (size_t w = 0; w < m_workers.size(); w++) {
+            if (m_workers[w].alive &&
+                (best == -1 || nb_channels(w) < nb_channels(best)))
+                best = w;
+        }
+        if (best == -1)
+            return;
+        assign(i, best);
+    }
+}
+
+// Move one channel from the busiest worker to the least busy one when
+// the difference between their loads is well above what one of the
+// channels costs, so that the move does not just swap them
+void coordinator::rebalance() {
+    int busiest = -1;
+    int idlest = -1;
+    for (size_t w = 0; w < m_workers.size(); w++) {
+        if (!m_workers[w].alive)
+            continue;
+        if (busiest == -1 || m_workers[w].load > m_workers[busiest].load)
+            busiest = w;
+        if (idlest == -1 || m_workers[w].load < m_workers[idlest].load)
+            idlest = w;
+    }
+    if (busiest == idlest || busiest == -1)
+        return;
+    // a move at a time
+    for (const channel_state & c : m_channels)
+        if (c.target != -1)
+            return;
+    int n = nb_channels(busiest);
+    double difference = m_workers[busiest].load - m_workers[idlest].load;
+    if (n == 0 || difference < 1.5 * m_workers[busiest].load / n)
+        return;
+    // the channel that has been the cheapest to move: the one that has
+    // been running there for the least time
+    int channel = -1;
+    for (size_t i = 0; i < m_channels.size(); i++) {
+        const channel_state & c = m_channels[i];
+        if (c.worker == busiest && !c.done &&
+            (channel == -1 || c.position - c.checkpoint <
+                              m_channels[channel].position - m_channels[channel].checkpoint))
+            channel = i;
+    }
+    if (channel == -1)
+        return;
+    log_event("load %.0f%% on worker %d, %.0f%% on worker %d: moving channel %d",
+              100 * m_workers[busiest].load, busiest, 100 * m_workers[idlest].load, idlest,
+              channel);
+    m_channels[channel].target = idlest;
+    m_workers[busiest].connection->send("revoke " + std::to_string(channel));
+}
+
+bool coordinator::receive(int worker) {
+    worker_state & w = m_workers[worker];
+    bool open = w.connection->receive();
+    std::vector<std::string> fields;
+    std::string payload;
+    while (w.connection->next(fields, payload))
+        if (!fields.empty())
+            handle(worker, fields, payload);
+    return open;
+}
+
+void coordinator::handle(int worker, const std::vector<std::string> & fields,
+                         const std::string & payload) {
+    worker_state & w = m_workers[worker];
+    const std::string & command = fields[0];
+    if (command == "hello" && fields.size() >= 2) {
+        w.pid = atoi(fields[1].c_str());
+        w.alive = true;
+        log_event("worker %d (pid %d) connected", worker, w.pid);
+        return;
+    }
+    if (command == "load" && fields.size() >= 2) {
+        w.load = atof(fields[1].c_str());
+        return;
+    }
+    if (fields.size() < 2)
+        return;
+    int i = atoi(fields[1].c_str());
+    if (i < 0 || i >= (int) m_channels.size() || m_channels[i].worker != worker)
+        return;
+    channel_state & c = m_channels[i];
+    if (command == "message" && fields.size() >= 3) {
+        // a channel resumed from a checkpoint decodes again the messages
+        // after it; two different messages cannot end within a second
+        long long sample = atoll(fields[2].c_str());
+        if (c.last_message != -1 && sample <= c.last_message + m_sample_rate)
+            return;
+        c.last_message = sample;
+        c.messages++;
+        w.messages++;
+        printf("[%s] %s\n", c.path.c_str(), payload.c_str());
+        fflush(stdout);
+    } else if (command == "checkpoint" && fields.size() >= 3) {
+        c.checkpoint = atoll(fields[2].c_str());
+    } else if (command == "stats" && fields.size() >= 4) {
+        c.position = atoll(fields[2].c_str());
+        c.cpu = atof(fields[3].c_str());
+    } else if (command == "done" && fields.size() >= 3) {
+        c.position = atoll(fields[2].c_str());
+        c.done = true;
+        c.worker = -1;
+        c.target = -1;
+        c.cpu_before += c.cpu;
+        c.cpu = 0;
+        w.done++;
+    } else if (command == "revoked" && fields.size() >= 3) {
+        c.checkpoint = atoll(fields[2].c_str());
+        c.worker = -1;
+        c.cpu_before += c.cpu;
+        c.cpu = 0;
+        c.moves++;
+        int target = c.target;
+        c.target = -1;
+        if (target != -1 && m_workers[target].alive) {
+            log_event("channel %d resumes on worker %d at %.1f s", i, target,
+                      (double) c.checkpoint / m_sample_rate);
+            assign(i, target);
+        }
+    } else if (command == "error") {
+        std::string reason;
+        for (size_t k = 2; k < fields.size(); k++)
+            reason += (k > 2 ? " " : "") + fields[k];
+        log_event("channel %d (%s) failed on worker %d: %s", i, c.path.c_str(), worker,
+                  reason.c_str());
+        c.done = true;
+        c.failed = true;
+        c.worker = -1;
+    }
+}
+
+void coordinator::worker_lost(int worker) {
+    worker_state & w = m_workers[worker];
+    if (w.alive)
+        log_event("worker %d (pid %d) lost", worker, w.pid);
+    w.alive = false;
+    for (size_t i = 0; i < m_channels.size(); i++) {
+        channel_state & c = m_channels[i];
+        if (c.target == worker)
+            c.target = -1;
+        if (c.worker != worker)
+            continue;
+        log_event("channel %d to resume at %.1f s", (int) i,
+                  (double) c.checkpoint / m_sample_rate);
+        c.worker = -1;
+        c.target = -1;
+        c.cpu_before += c.cpu;
+        c.cpu = 0;
+        c.moves++;
+    }
+}
+
+void coordinator::report() const {
+    printf("channel  seconds  messages  moves  CPU (s)  state\n");
+    for (size_t i = 0; i < m_channels.size(); i++) {
+        const channel_state & c = m_channels[i];
+        printf("%7d  %7.1f  %8d  %5d  %7.2f  %-7s  %s\n", (int) i,
+               (double) c.position / m_sample_rate, c.messages, c.moves,
+               c.cpu_before + c.cpu, c.failed ? "failed" : c.done ? "done" : "pending",
+               c.path.c_str());
+    }
+    printf("worker  pid      done  messages  state\n");
+    for (size_t w = 0; w < m_workers.size(); w++) {
+        const worker_state & s = m_workers[w];
+        printf("%6d  %-7d  %4d  %8d  %s\n", (int) w, s.pid, s.done, s.messages,
+               s.alive ? "alive" : "lost");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string socket_path = "/tmp/navtex_coordinator." + std::to_string(getpid());
+    int nb_workers = default_workers;
+    std::string worker_program;
+    double speed = 0;
+    double rebalance_interval = default_rebalance;
+
+    static const struct option long_options[] = {
+        { "socket",    required_argument, nullptr, 's' },
+        { "workers",   required_argument, nullptr, 'w' },
+        { "worker",    required_argument, nullptr, 'W' },
+        { "speed",     required_argument, nullptr, 'x' },
+        { "rebalance", required_argument, nullptr, 'r' },
+        { "help",      no_argument,       nullptr, 'h' },
+        { nullptr,     0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:w:W:x:r:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'w':
+            if (sscanf(optarg, "%d", &nb_workers) != 1 || nb_workers < 0) {
+                fprintf(stderr, "invalid number of workers: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'W':
+            worker_program = optarg;
+            break;
+        case 'x':
+            if (sscanf(optarg, "%lf", &speed) != 1 || speed < 0) {
+                fprintf(stderr, "invalid speed: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            if (sscanf(optarg, "%lf", &rebalance_interval) != 1 || rebalance_interval < 0) {
+                fprintf(stderr, "invalid rebalance interval: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int nargs = argc - optind;
+    char ** args = argv + optind;
+    if (nargs < 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int sample_rate;
+    if (sscanf(args[0], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", args[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (worker_program.empty()) {
+        std::string self = argv[0];
+        size_t slash = self.rfind('/');
+        worker_program = (slash == std::string::npos ? "" : self.substr(0, slash + 1)) +
+                         "navtex_worker";
+    }
+
+    coordinator coord(sample_rate, speed);
+    for (int i = 1; i < nargs; i++)
+        coord.add_channel(args[i]);
+
+    int listen_fd = shard_listen(socket_path);
+    if (listen_fd == -1) {
+        fprintf(stderr, "cannot listen on %s: %s\n", socket_path.c_str(), strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    start_time = now_seconds();
+    std::vector<pid_t> children;
+    for (int i = 0; i < nb_workers; i++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            fprintf(stderr, "fork() failed: %s\n", strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            execl(worker_program.c_str(), worker_program.c_str(), socket_path.c_str(),
+                  (char *) nullptr);
+            fprintf(stderr, "cannot run %s: %s\n", worker_program.c_str(), strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+        children.push_back(pid);
+    }
+    if (nb_workers == 0)
+        log_event("waiting for workers on %s", socket_path.c_str());
+
+    bool assigning = false;
+    double last_rebalance = now_seconds();
+    double last_alive = now_seconds();
+    while (!coord.finished()) {
+        std::vector<worker_state> & workers = coord.workers();
+        std::vector<struct pollfd> pfds;
+        std::vector<int> polled;
+        pfds.push_back({ listen_fd, POLLIN, 0 });
+        for (size_t w = 0; w < workers.size(); w++) {
+            if (workers[w].connection) {
+                pfds.push_back({ workers[w].connection->fd(), POLLIN, 0 });
+                polled.push_back(w);
+            }
+        }
+        if (poll(pfds.data(), pfds.size(), 200) == -1 && errno != EINTR) {
+            fprintf(stderr, "poll() failed: %s\n", strerror(errno));
+            break;
+        }
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd != -1)
+                coord.add_worker(fd);
+        }
+        for (size_t k = 1; k < pfds.size(); k++) {
+            int w = polled[k - 1];
+            if (pfds[k].revents == 0)
+                continue;
+            if (!coord.receive(w)) {
+                coord.worker_lost(w);
+                coord.workers()[w].connection.reset();
+            }
+        }
+
+        double now = now_seconds();
+        int alive = coord.nb_alive();
+        if (alive > 0)
+            last_alive = now;
+        if (!assigning)
+            assigning = alive > 0 && (alive >= nb_workers || now - start_time > startup_timeout);
+        if (assigning)
+            coord.assign_waiting();
+        if (alive == 0 && now - last_alive > orphan_timeout &&
+            (nb_workers > 0 || assigning)) {
+            log_event("no worker left");
+            break;
+        }
+        if (rebalance_interval > 0 && now - last_rebalance >= rebalance_interval) {
+            coord.rebalance();
+            last_rebalance = now;
+        }
+    }
+
+    for (worker_state & w : coord.workers())
+        if (w.connection)
+            w.connection->send("quit");
+    for (pid_t pid : children)
+        waitpid(pid, nullptr, 0);
+    close(listen_fd);
+    unlink(socket_path.c_str());
+
+    coord.report();
+
+    return coord.finished() ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_fanout.h"
+#include "navtex_rx.h"
+
+sample_block::sample_block(block_pool & pool, int capacity) :
+    m_pool(pool),
+    m_data(new short[capacity]),
+    m_capacity(capacity),
+    m_size(0),
+    m_position(0),
+    m_refs(0) {
+}
+
+// The consumers only read the block, but the producer writes it again
+// once it is back in the pool: the last release must see all the reads
+void sample_block::release() {
+    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        m_pool.put_back(this);
+}
+
+
+block_pool::block_pool(int block_size, int nb_blocks) :
+    m_block_size(block_size) {
+    m_blocks.reserve(nb_blocks);
+    m_free.reserve(nb_blocks);
+    for (int i = 0; i < nb_blocks; i++) {
+        m_blocks.emplace_back(new sample_block(*this, block_size));
+        m_free.push_back(m_blocks.back().get());
+    }
+}
+
+sample_block * block_pool::acquire() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_released.wait(lock, [this] { return !m_free.empty(); });
+    sample_block * block = m_free.back();
+    m_free.pop_back();
+    block->m_size = 0;
+    block->m_refs.store(1, std::memory_order_relaxed);
+    return block;
+}
+
+void block_pool::put_back(sample_block * block) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(block);
+    }
+    m_released.notify_one();
+}
+
+
+sample_fanout::consumer::consumer(navtex_rx & rx, int queue_len) :
+    rx(rx),
+    queue(queue_len),
+    head(0),
+    count(0),
+    done(false) {
+}
+
+void sample_fanout::consumer::run() {
+    for (;;) {
+        sample_block * block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this] { return count > 0 || done; });
+            if (count == 0)
+                return;
+            block = queue[head];
+        }
+        // a gap in the stream (blocks the producer did not publish)
+        if (block->position() > rx.samples_in())
+            rx.skip_samples(block->position() - rx.samples_in());
+        rx.process_data(block->data(), block->size());
+        block->release();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            head = (head + 1) % queue.size();
+            count--;
+        }
+        not_full.notify_one();
+    }
+}
+
+sample_fanout::sample_fanout(int queue_len) :
+    m_queue_len(queue_len),
+    m_started(false) {
+}
+
+sample_fanout::~sample_fanout() {
+    finish();
+}
+
+void sample_fanout::add_consumer(navtex_rx & rx) {
+    m_consumers.emplace_back(new consumer(rx, m_queue_len));
+}
+
+void sample_fanout::start() {
+    for (auto & c : m_consumers)
+        c->thread = std::thread(&consumer::run, c.get());
+    m_started = true;
+}
+
+void sample_fanout::publish(sample_block * block) {
+    // one reference per consumer, the one of the caller included
+    for (size_t i = 1; i < m_consumers.size(); i++)
+        block->retain();
+    if (m_consumers.empty()) {
+        block->release();
+        return;
+    }
+    for (auto & c : m_consumers) {
+        {
+            std::unique_lock<std::mutex> lock(c->mutex);
+            c->not_full.wait(lock, [&] { return c->count < c->queue.size(); });
+            c->queue[(c->head + c->count) % c->queue.size()] = block;
+            c->count++;
+        }
+        c->not_empty.notify_one();
+    }
+}
+
+void sample_fanout::finish() {
+    if (!m_started)
+        return;
+    for (auto & c : m_consumers) {
+        {
+            std::lock_guard<std::mutex> lock(c->mutex);
+            c->done = true;
+        }
+        c->not_empty.notify_one();
+    }
+    for (auto & c : m_consumers) {
+        c->thread.join();
+        c->rx.finish();
+    }
+    m_started = false;
+}
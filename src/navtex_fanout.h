@@ -0,0 +1,118 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_FANOUT_H
+#define _NAVTEX_FANOUT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class navtex_rx;
+class block_pool;
+
+// A block of input samples shared by several consumers: the producer
+// fills it, and from then on it is only read, until the last consumer
+// releases it and it goes back to its pool to be filled again
+class sample_block {
+public:
+    // for the producer, before the block is published
+    short * data() { return m_data.get(); }
+    void set_size(int size) { m_size = size; }
+    void set_position(long long position) { m_position = position; }
+
+    const short * data() const { return m_data.get(); }
+    int size() const { return m_size; }
+    int capacity() const { return m_capacity; }
+    // position in the stream of the first sample
+    long long position() const { return m_position; }
+
+    void retain() { m_refs.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+
+private:
+    friend class block_pool;
+    sample_block(block_pool & pool, int capacity);
+
+    block_pool & m_pool;
+    std::unique_ptr<short[]> m_data;
+    int m_capacity;
+    int m_size;
+    long long m_position;
+    std::atomic<int> m_refs;
+}; // sample_block
+
+// Fixed set of blocks, allocated up front and recycled
+class block_pool {
+public:
+    block_pool(int block_size, int nb_blocks);
+    block_pool(const block_pool &) = delete;
+    block_pool & operator=(const block_pool &) = delete;
+
+    // A free block, with one reference owned by the caller; waits for a
+    // block to be released if they are all in use
+    sample_block * acquire();
+    int block_size() const { return m_block_size; }
+
+private:
+    friend class sample_block;
+    void put_back(sample_block * block);
+
+    int m_block_size;
+    std::vector<std::unique_ptr<sample_block>> m_blocks;
+    std::vector<sample_block *> m_free;
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+}; // block_pool
+
+// Hands the blocks of one input stream to several decoders, each running
+// on its own thread; the decoders share the blocks, nothing is copied.
+// Each decoder has a queue of queue_len blocks: when a decoder falls
+// behind, publish() waits for it, so that the pool never runs dry
+// because of one slow consumer and no block is ever dropped.
+class sample_fanout {
+public:
+    explicit sample_fanout(int queue_len = 16);
+    ~sample_fanout();
+    sample_fanout(const sample_fanout &) = delete;
+    sample_fanout & operator=(const sample_fanout &) = delete;
+
+    // add the decoders before start()
+    void add_consumer(navtex_rx & rx);
+    void start();
+    // Pass block to all the consumers; the reference of the caller is
+    // handed over with it
+    void publish(sample_block * block);
+    // Wait until every consumer has processed all the blocks published,
+    // and stop the threads
+    void finish();
+
+private:
+    struct consumer {
+        navtex_rx & rx;
+        std::thread thread;
+        std::vector<sample_block *> queue;
+        size_t head;
+        size_t count;
+        bool done;
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+
+        consumer(navtex_rx & rx, int queue_len);
+        void run();
+    };
+
+    int m_queue_len;
+    std::vector<std::unique_ptr<consumer>> m_consumers;
+    bool m_started;
+}; // sample_fanout
+
+#endif /* _NAVTEX_FANOUT_H */
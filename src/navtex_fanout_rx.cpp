@@ -0,0 +1,171 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// decode one NAVTEX input stream (signed LE16) with several decoders at
+// once (different center frequencies, polarities, SITOR-B only), each
+// on its own thread; the decoders share the input blocks, and the
+// messages they save are printed with the name of the decoder
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "navtex_fanout.h"
+#include "navtex_rx.h"
+
+constexpr int BUFSIZE = 8192;
+constexpr int NB_BLOCKS = 64;
+constexpr double center_frequency = 1000.0;
+
+static std::mutex output_mutex;
+
+// navtex_rx that prints its messages with its name
+class labeled_rx : public navtex_rx {
+public:
+    labeled_rx(const std::string & name, int sample_rate, bool only_sitor_b,
+               bool reverse, bool compact) :
+        navtex_rx(sample_rate, only_sitor_b, reverse, nullptr, nullptr, stderr,
+                  compact),
+        m_name(name) {}
+
+protected:
+    void put_received_message(const ccir_message & ccir_msg,
+                              const std::string & message) override {
+        (void) ccir_msg;
+        std::lock_guard<std::mutex> lock(output_mutex);
+        printf("[%s] %s\n", m_name.c_str(), message.c_str());
+        fflush(stdout);
+    }
+
+private:
+    std::string m_name;
+};
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate [file|-]\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -d, --decoder=SPEC  add a decoder; SPEC is a center frequency offset in\n");
+    fprintf(stderr, "                      Hz, followed by any of ':r' (reverse), ':b' (SITOR-B\n");
+    fprintf(stderr, "                      only) and ':c' (compact), for instance -d -20:r\n");
+    fprintf(stderr, "                      (default: a single decoder, -d 0)\n");
+    fprintf(stderr, "  -h, --help          show this help\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> specs;
+
+    static const struct option long_options[] = {
+        { "decoder", required_argument, nullptr, 'd' },
+        { "help",    no_argument,       nullptr, 'h' },
+        { nullptr,   0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            specs.push_back(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int nargs = argc - optind;
+    char ** args = argv + optind;
+    if (nargs < 1 || nargs > 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (specs.empty())
+        specs.push_back("0");
+
+    int sample_rate;
+    if (sscanf(args[0], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", args[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::unique_ptr<labeled_rx>> decoders;
+    for (const std::string & spec : specs) {
+        double offset;
+        int n;
+        if (sscanf(spec.c_str(), "%lf%n", &offset, &n) != 1) {
+            fprintf(stderr, "invalid decoder: %s\n", spec.c_str());
+            exit(EXIT_FAILURE);
+        }
+        bool reverse = false, only_sitor_b = false, compact = false;
+        for (size_t i = n; i < spec.size(); i += 2) {
+            char flag = i + 1 < spec.size() && spec[i] == ':' ? spec[i + 1] : '\0';
+            if (flag == 'r') {
+                reverse = true;
+            } else if (flag == 'b') {
+                only_sitor_b = true;
+            } else if (flag == 'c') {
+                compact = true;
+            } else {
+                fprintf(stderr, "invalid decoder: %s\n", spec.c_str());
+                exit(EXIT_FAILURE);
+            }
+        }
+        decoders.emplace_back(new labeled_rx(spec, sample_rate, only_sitor_b,
+                                             reverse, compact));
+        decoders.back()->set_center_frequency(center_frequency + offset);
+    }
+
+    int fd = fileno(stdin);
+    if (nargs == 2 && strcmp(args[1], "-") != 0) {
+        fd = open(args[1], O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "open(%s) failed: %s\n", args[1], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    block_pool pool(BUFSIZE, NB_BLOCKS);
+    sample_fanout fanout;
+    for (auto & rx : decoders)
+        fanout.add_consumer(*rx);
+    fanout.start();
+
+    // the samples are read straight into the shared blocks
+    long long position = 0;
+    for (;;) {
+        sample_block * block = pool.acquire();
+        ssize_t nread = read(fd, block->data(), block->capacity() * sizeof(short));
+        if (nread < 0) {
+            fprintf(stderr, "read() failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (nread == 0) {
+            block->release();
+            break;
+        }
+        int nb_samples = nread / sizeof(short);
+        block->set_size(nb_samples);
+        block->set_position(position);
+        position += nb_samples;
+        fanout.publish(block);
+    }
+    fanout.finish();
+
+    if (fd != fileno(stdin))
+        close(fd);
+
+    return 0;
+}
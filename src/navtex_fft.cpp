@@ -0,0 +1,190 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_fft.h"
+#include "gfft.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// points in a cache line
+static const int lines = 64 / sizeof(std::complex<double>);
+// up to this size, a single g_fft is as fast (and its rows could not be
+// shorter than 16 points); with a single thread, it is faster at any size
+static const int max_serial = 16384;
+
+parallel_fft::parallel_fft(int size, int nb_threads) :
+    m_nb_tasks(0),
+    m_generation(0),
+    m_pending(0),
+    m_stopping(false) {
+    int m = 4;
+    while ((1 << m) < size && m < 28)
+        m++;
+    m_size = 1 << m;
+    nb_threads = std::max(nb_threads, 1);
+    if (m_size <= max_serial)
+        nb_threads = 1;
+    m_n1 = nb_threads == 1 ? m_size : 1 << (m / 2);
+    m_n2 = m_size / m_n1;
+    m_shift = m / 2;
+    m_coarse.resize(m_size >> m_shift);
+    m_fine.resize(1 << m_shift);
+    for (size_t a = 0; a < m_coarse.size(); a++)
+        m_coarse[a] = std::polar(1.0, -2 * M_PI * ((double) a * (1 << m_shift)) / m_size);
+    for (size_t b = 0; b < m_fine.size(); b++)
+        m_fine[b] = std::polar(1.0, -2 * M_PI * (double) b / m_size);
+    if (m_n2 > 1) {
+        m_work.reset(new cmplx[m_size]);
+        m_columns.reset(new cmplx[(size_t) nb_threads * lines * m_n1]);
+    }
+
+    for (int t = 0; t < nb_threads; t++) {
+        m_fft1.emplace_back(new g_fft<double>(m_n1));
+        if (m_n2 > 1)
+            m_fft2.emplace_back(new g_fft<double>(m_n2));
+    }
+    for (int t = 1; t < nb_threads; t++)
+        m_threads.emplace_back(&parallel_fft::thread_main, this, t);
+}
+
+parallel_fft::~parallel_fft() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_start.notify_all();
+    for (std::thread & thread : m_threads)
+        thread.join();
+}
+
+size_t parallel_fft::footprint() const {
+    size_t size = sizeof(*this) + (m_coarse.size() + m_fine.size()) * sizeof(cmplx);
+    if (m_work)
+        size += (m_size + (m_threads.size() + 1) * lines * m_n1) * sizeof(cmplx);
+    for (auto & fft : m_fft1)
+        size += fft->footprint();
+    for (auto & fft : m_fft2)
+        size += fft->footprint();
+    return size;
+}
+
+// without the checks for infinities and NaNs of the std::complex
+// operator, which make it several times slower
+static inline std::complex<double> multiply(std::complex<double> a, std::complex<double> b) {
+    return std::complex<double>(a.real() * b.real() - a.imag() * b.imag(),
+                                a.real() * b.imag() + a.imag() * b.real());
+}
+
+// W_N^j, from the two tables (j < N)
+inline parallel_fft::cmplx parallel_fft::twiddle(long long j) const {
+    return multiply(m_coarse[j >> m_shift], m_fine[j & ((1 << m_shift) - 1)]);
+}
+
+// The share of thread of the m_nb_tasks tasks of the current pass
+void parallel_fft::slice(int thread, int & begin, int & end) const {
+    int nb_threads = m_threads.size() + 1;
+    begin = (long long) m_nb_tasks * thread / nb_threads;
+    end = (long long) m_nb_tasks * (thread + 1) / nb_threads;
+}
+
+// Run task(thread, begin, end) on all the threads, the calling one
+// included, over nb_tasks tasks, and wait for the end of the pass
+void parallel_fft::run(int nb_tasks, std::function<void(int, int, int)> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = task;
+        m_nb_tasks = nb_tasks;
+        m_pending = m_threads.size();
+        m_generation++;
+    }
+    m_start.notify_all();
+    int begin, end;
+    slice(0, begin, end);
+    task(0, begin, end);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&] { return m_pending == 0; });
+}
+
+void parallel_fft::thread_main(int thread) {
+    long long generation = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_start.wait(lock, [&] { return m_stopping || m_generation != generation; });
+        if (m_stopping)
+            break;
+        generation = m_generation;
+        int begin, end;
+        slice(thread, begin, end);
+        lock.unlock();
+        m_task(thread, begin, end);
+        lock.lock();
+        if (--m_pending == 0)
+            m_done.notify_one();
+    }
+}
+
+void parallel_fft::forward(cmplx * data) {
+    forward(data, data);
+}
+
+// With n = N2 n1 + n2 and k = k1 + N1 k2:
+// X[k] = sum_n2 W_N2^(n2 k2) W_N^(n2 k1) sum_n1 x[N2 n1 + n2] W_N1^(n1 k1)
+// Both passes go a cache line wide: the columns of the input a few at a
+// time through a buffer of the thread, and the rows of the result to the
+// output (a transpose) a few at a time.
+void parallel_fft::forward(const cmplx * in, cmplx * out) {
+    if (m_n2 == 1) {
+        if (out != in)
+            memcpy(out, in, m_size * sizeof(cmplx));
+        m_fft1[0]->ComplexFFT(out);
+        return;
+    }
+    cmplx * work = m_work.get();
+    // 1. work[k1][n2] = W_N^(n2 k1) sum_n1 x[N2 n1 + n2] W_N1^(n1 k1)
+    run(m_n2 / lines, [&](int thread, int begin, int end) {
+        cmplx * buffer = m_columns.get() + (size_t) thread * lines * m_n1;
+        for (int n2 = begin * lines; n2 < end * lines; n2 += lines) {
+            for (int n1 = 0; n1 < m_n1; n1++)
+                for (int c = 0; c < lines; c++)
+                    buffer[c * m_n1 + n1] = in[(size_t) n1 * m_n2 + n2 + c];
+            for (int c = 0; c < lines; c++) {
+                cmplx * column = buffer + c * m_n1;
+                m_fft1[thread]->ComplexFFT(column);
+                for (int k1 = 1; k1 < m_n1 && n2 + c > 0; k1++)
+                    column[k1] = multiply(column[k1], twiddle((long long) (n2 + c) * k1));
+            }
+            for (int k1 = 0; k1 < m_n1; k1++)
+                for (int c = 0; c < lines; c++)
+                    work[(size_t) k1 * m_n2 + n2 + c] = buffer[c * m_n1 + k1];
+        }
+    });
+    // 2. X[k1 + N1 k2] = sum_n2 work[k1][n2] W_N2^(n2 k2)
+    run(m_n1 / lines, [&](int thread, int begin, int end) {
+        for (int k1 = begin * lines; k1 < end * lines; k1 += lines) {
+            for (int c = 0; c < lines; c++)
+                m_fft2[thread]->ComplexFFT(work + (size_t) (k1 + c) * m_n2);
+            for (int k2 = 0; k2 < m_n2; k2++)
+                for (int c = 0; c < lines; c++)
+                    out[(size_t) k2 * m_n1 + k1 + c] = work[(size_t) (k1 + c) * m_n2 + k2];
+        }
+    });
+}
+
+// ifft(x) = conj(fft(conj(x))) / N
+void parallel_fft::inverse(cmplx * data) {
+    run(m_n1, [&](int, int begin, int end) {
+        for (size_t i = (size_t) begin * m_n2; i < (size_t) end * m_n2; i++)
+            data[i] = std::conj(data[i]);
+    });
+    forward(data);
+    double scale = 1.0 / m_size;
+    run(m_n1, [&](int, int begin, int end) {
+        for (size_t i = (size_t) begin * m_n2; i < (size_t) end * m_n2; i++)
+            data[i] = std::conj(data[i]) * scale;
+    });
+}
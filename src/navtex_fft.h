@@ -0,0 +1,84 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_FFT_H
+#define _NAVTEX_FFT_H
+
+#include <complex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template <typename FFT_TYPE> class g_fft;
+
+// Complex FFT for the wideband work (spectrum search over a whole band,
+// channelisation), where the transforms (64K to 1M points) are far
+// bigger than the cache. The four-step algorithm sees the N points as an
+// N1 x N2 matrix, with N1 and N2 about sqrt(N), and transforms its
+// columns and then its rows: each of them is small enough for g_fft to
+// run it in the primary cache, and each pass reads and writes the whole
+// transform only once, a cache line at a time. The twiddle factors come
+// from two tables of sqrt(N) entries. The columns and the rows of each
+// pass are shared among a pool of threads. With a single thread, or up to
+// 16K points, it is a single g_fft, which is faster then. The per channel
+// filters keep using g_fft directly, which is faster at their sizes.
+class parallel_fft {
+public:
+    // size: rounded up to a power of two (at least 16); nb_threads
+    // includes the calling thread
+    parallel_fft(int size, int nb_threads);
+    ~parallel_fft();
+    parallel_fft(const parallel_fft &) = delete;
+    parallel_fft & operator=(const parallel_fft &) = delete;
+
+    int size() const { return m_size; }
+    // In place, in natural order: X[k] = sum x[n] exp(-2 pi i n k / N),
+    // like g_fft::ComplexFFT()
+    void forward(std::complex<double> * data);
+    // From in to out (which can be the same)
+    void forward(const std::complex<double> * in, std::complex<double> * out);
+    // In place, scaled by 1/N like g_fft::InverseComplexFFT()
+    void inverse(std::complex<double> * data);
+    // bytes of memory used, tables and work buffer included
+    size_t footprint() const;
+
+private:
+    typedef std::complex<double> cmplx;
+
+    int m_size;
+    int m_n1;                   // row length of the first pass
+    int m_n2;                   // and of the second one
+    int m_shift;                // twiddle W^j = m_coarse[j >> shift] * m_fine[j & mask]
+    std::vector<cmplx> m_coarse;
+    std::vector<cmplx> m_fine;
+    std::unique_ptr<cmplx[]> m_work;
+    std::unique_ptr<cmplx[]> m_columns; // column buffer of each thread
+    // one transform of each row length per thread
+    std::vector<std::unique_ptr<g_fft<double>>> m_fft1;
+    std::vector<std::unique_ptr<g_fft<double>>> m_fft2;
+
+    // thread pool: run() hands out [begin, end) ranges of a pass
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    std::function<void(int, int, int)> m_task;
+    int m_nb_tasks;
+    long long m_generation;
+    int m_pending;
+    bool m_stopping;
+
+    void run(int nb_tasks, std::function<void(int, int, int)> task);
+    void thread_main(int thread);
+    void slice(int thread, int & begin, int & end) const;
+    cmplx twiddle(long long j) const;
+}; // parallel_fft
+
+#endif /* _NAVTEX_FFT_H */
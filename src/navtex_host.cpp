@@ -0,0 +1,326 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_activity.h"
+#include "navtex_fanout.h"
+#include "navtex_host.h"
+#include "navtex_placement.h"
+#include "navtex_rx.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <map>
+
+static double thread_cpu_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+channel_host::channel::channel(navtex_rx * rx, rx_factory make_rx, int sample_rate,
+                               priority prio, int group, int queue_len) :
+    rx(rx),
+    make_rx(make_rx),
+    sample_rate(sample_rate),
+    prio(prio),
+    group(group),
+    worker(-1),
+    queue_len(queue_len),
+    head(0),
+    count(0),
+    running(false),
+    current_engine(FULL),
+    next_engine(FULL),
+    squelch_open_until(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+channel_host::channel::~channel() = default;
+
+// Allocate the decoder (when the host makes it) and the queue, on the
+// thread that will run the channel with the PINNED placement
+void channel_host::channel::build() {
+    if (make_rx) {
+        owned_rx.reset(make_rx());
+        rx = owned_rx.get();
+    }
+    queue.assign(queue_len, entry());
+    current_engine = rx->compact() ? REDUCED : FULL;
+    next_engine = current_engine;
+    stats.engine = current_engine;
+    stats.requested_engine = current_engine;
+}
+
+// Decode block with engine e; returns whether the channel is active (the
+// decoder is locked, or the squelch is open)
+bool channel_host::channel::process(const sample_block * block, engine e) {
+    if (e != current_engine) {
+        rx->set_compact(e != FULL);
+        if (e == MONITOR)
+            squelch_open_until = 0;
+        current_engine = e;
+    }
+    // a gap in the input (blocks dropped by an overrun)
+    if (block->position() > rx->samples_in())
+        rx->skip_samples(block->position() - rx->samples_in());
+    if (e == MONITOR) {
+        if (!squelch)
+            squelch.reset(new activity_scanner(sample_rate));
+        // the squelch stays open for a while after the activity, as the
+        // decoder needs that signal to finish the message
+        long long end = block->position() + block->size();
+        if (squelch->ratio(block->data(), block->size()) > squelch->threshold)
+            squelch_open_until = end + (long long) (squelch->post_margin * sample_rate);
+        if (block->position() >= squelch_open_until) {
+            rx->skip_samples(block->size());
+            return false;
+        }
+        rx->process_data(block->data(), block->size());
+        return true;
+    }
+    rx->process_data(block->data(), block->size());
+    return rx->locked();
+}
+
+channel_host::channel_host(int nb_threads, int queue_len) :
+    m_nb_threads(std::max(nb_threads, 1)),
+    m_queue_len(std::max(queue_len, 1)),
+    m_placement(FLOATING),
+    m_nb_ready(0),
+    m_queued(0),
+    m_finishing(false),
+    m_busy_seconds{ 0, 0 } {
+}
+
+channel_host::~channel_host() {
+    finish();
+}
+
+int channel_host::add_channel(navtex_rx & rx, int sample_rate, priority prio, int group) {
+    m_channels.emplace_back(new channel(&rx, nullptr, sample_rate, prio, group,
+                                        m_queue_len));
+    return m_channels.size() - 1;
+}
+
+int channel_host::add_channel(rx_factory make_rx, int sample_rate, priority prio,
+                              int group) {
+    m_channels.emplace_back(new channel(nullptr, make_rx, sample_rate, prio, group,
+                                        m_queue_len));
+    return m_channels.size() - 1;
+}
+
+// The groups (a channel without a group being a group of its own) go, the
+// heaviest first, to the worker with the fewest samples per second so far
+void channel_host::assign_workers() {
+    std::map<int, std::vector<int>> groups;
+    for (size_t i = 0; i < m_channels.size(); i++) {
+        int group = m_channels[i]->group;
+        groups[group >= 0 ? group : -1 - (int) i].push_back(i);
+    }
+    std::vector<std::pair<long long, const std::vector<int> *>> by_load;
+    for (auto & group : groups) {
+        long long load = 0;
+        for (int i : group.second)
+            load += m_channels[i]->sample_rate;
+        by_load.emplace_back(load, &group.second);
+    }
+    std::stable_sort(by_load.begin(), by_load.end(),
+                     [](const std::pair<long long, const std::vector<int> *> & a,
+                        const std::pair<long long, const std::vector<int> *> & b) {
+                         return a.first > b.first;
+                     });
+    std::vector<long long> worker_load(m_nb_threads, 0);
+    for (auto & group : by_load) {
+        int worker = std::min_element(worker_load.begin(), worker_load.end()) -
+                     worker_load.begin();
+        worker_load[worker] += group.first;
+        for (int i : *group.second)
+            m_channels[i]->worker = worker;
+    }
+}
+
+void channel_host::start() {
+    m_finishing = false;
+    m_nb_ready = 0;
+    m_worker_cpus.assign(m_nb_threads, -1);
+    if (m_placement == PINNED) {
+        std::vector<int> cpus = placement_cpus();
+        for (int t = 0; t < m_nb_threads && !cpus.empty(); t++)
+            m_worker_cpus[t] = cpus[t % cpus.size()];
+        assign_workers();
+    } else {
+        for (auto & c : m_channels) {
+            c->worker = -1;
+            c->build();
+        }
+    }
+    for (int t = 0; t < m_nb_threads; t++)
+        m_workers.emplace_back(&channel_host::run, this, t);
+    // the workers build their channels before anything can be queued
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_ready.wait(lock, [&] { return m_nb_ready == m_nb_threads; });
+}
+
+bool channel_host::push(int channel_number, sample_block * block) {
+    channel & c = *m_channels[channel_number];
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (c.count == c.queue.size()) {
+            if (c.prio == REALTIME) {
+                c.stats.overruns++;
+                c.stats.dropped_samples += block->size();
+                lock.unlock();
+                block->release();
+                return false;
+            }
+            m_room.wait(lock, [&] { return c.count < c.queue.size(); });
+        }
+        // if the input keeps coming in real time, the queue is full
+        // queue_len blocks from now
+        clock::time_point now = clock::now();
+        std::chrono::duration<double> budget((double) c.queue.size() * block->size() /
+                                             c.sample_rate);
+        entry & e = c.queue[(c.head + c.count) % c.queue.size()];
+        e.block = block;
+        e.pushed = now;
+        e.deadline = now + std::chrono::duration_cast<clock::duration>(budget);
+        c.count++;
+        c.stats.max_queue = std::max(c.stats.max_queue, (int) c.count);
+        m_queued++;
+    }
+    // with the PINNED placement, only one of the workers can run it
+    if (c.worker == -1)
+        m_work.notify_one();
+    else
+        m_work.notify_all();
+    return true;
+}
+
+void channel_host::finish() {
+    if (m_workers.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finishing = true;
+    }
+    m_work.notify_all();
+    for (std::thread & worker : m_workers)
+        worker.join();
+    m_workers.clear();
+    for (auto & c : m_channels)
+        c->rx->finish();
+}
+
+void channel_host::set_engine(int channel_number, engine e) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_channels[channel_number]->next_engine = e;
+    m_channels[channel_number]->stats.requested_engine = e;
+}
+
+double channel_host::busy_seconds() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_busy_seconds[REALTIME] + m_busy_seconds[BACKGROUND];
+}
+
+double channel_host::busy_seconds(priority prio) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_busy_seconds[prio];
+}
+
+channel_stats channel_host::stats(int channel_number) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_channels[channel_number]->stats;
+}
+
+// The real-time channel with the earliest deadline, or else the
+// background channel that has been waiting the longest, among the ones
+// worker can run; -1 if no channel can run (called with the mutex held)
+int channel_host::next_channel(int worker) const {
+    int best = -1;
+    for (size_t i = 0; i < m_channels.size(); i++) {
+        const channel & c = *m_channels[i];
+        if (c.count == 0 || c.running || (c.worker != -1 && c.worker != worker))
+            continue;
+        if (best == -1) {
+            best = i;
+            continue;
+        }
+        const channel & b = *m_channels[best];
+        if (c.prio != b.prio) {
+            if (c.prio == REALTIME)
+                best = i;
+        } else if (c.prio == REALTIME ? c.queue[c.head].deadline < b.queue[b.head].deadline
+                                      : c.queue[c.head].pushed < b.queue[b.head].pushed) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// A channel runs on one worker at a time, one block at a time, so that
+// the next channel is chosen again after each block
+void channel_host::run(int worker) {
+    if (m_placement == PINNED) {
+        if (m_worker_cpus[worker] != -1 && !pin_thread(m_worker_cpus[worker]))
+            m_worker_cpus[worker] = -1;
+        for (auto & c : m_channels)
+            if (c->worker == worker)
+                c->build();
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_nb_ready++;
+    m_ready.notify_all();
+    for (;;) {
+        int i = -1;
+        m_work.wait(lock, [&] {
+            i = next_channel(worker);
+            return i != -1 || (m_finishing && m_queued == 0);
+        });
+        if (i == -1)
+            break;
+        channel & c = *m_channels[i];
+        entry e = c.queue[c.head];
+        engine eng = c.next_engine;
+        c.running = true;
+        lock.unlock();
+
+        clock::time_point start = clock::now();
+        std::chrono::duration<double> delay = start - e.pushed;
+        sample_block * block = e.block;
+        int size = block->size();
+        double cpu_start = thread_cpu_seconds();
+        bool active = c.process(block, eng);
+        bool locked = c.rx->locked();
+        double cpu = thread_cpu_seconds() - cpu_start;
+        std::chrono::duration<double> busy = clock::now() - start;
+        block->release();
+
+        lock.lock();
+        c.head = (c.head + 1) % c.queue.size();
+        c.count--;
+        c.running = false;
+        m_queued--;
+        c.stats.samples += size;
+        c.stats.blocks++;
+        c.stats.cpu_seconds += cpu;
+        c.stats.max_delay = std::max(c.stats.max_delay, delay.count());
+        if (c.stats.engine != eng)
+            c.stats.engine_changes++;
+        c.stats.engine = eng;
+        c.stats.engine_samples[eng] += size;
+        c.stats.locked = locked;
+        c.stats.idle_samples = active ? 0 : c.stats.idle_samples + size;
+        m_busy_seconds[c.prio] += busy.count();
+        // the channel can run again (by another worker, unless it is
+        // pinned to this one), and its producer may be waiting
+        if (c.worker == -1)
+            m_work.notify_one();
+        m_room.notify_all();
+    }
+    // let the other workers see that there is nothing left
+    m_work.notify_all();
+}
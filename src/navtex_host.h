@@ -0,0 +1,165 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_HOST_H
+#define _NAVTEX_HOST_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class activity_scanner;
+class navtex_rx;
+class sample_block;
+
+// Per channel accounting of a channel_host
+struct channel_stats {
+    long long samples;          // samples processed
+    long long blocks;           // blocks processed
+    double cpu_seconds;         // thread CPU time spent in the decoder
+    long long overruns;         // blocks dropped because the queue was full
+    long long dropped_samples;  // samples in those blocks
+    int max_queue;              // most blocks waiting in the queue
+    double max_delay;           // longest wait of a block in the queue (s)
+    int engine;                 // channel_host::engine in use
+    int requested_engine;       // the one set for the next block
+    long long engine_samples[3]; // samples processed with each engine
+    long long engine_changes;
+    bool locked;                // the decoder is locked on a signal
+    long long idle_samples;     // samples since it was last locked (or,
+                                // with the monitor engine, active)
+};
+
+// Runs many decoders, each with its own input queue, on a fixed pool of
+// worker threads. A worker always runs the real-time channel closest to
+// an overrun first (earliest deadline first, the deadline of a block
+// being when the queue would be full if the input keeps coming in real
+// time); background channels (replays, for instance) only run when no
+// real-time channel has input waiting, so they soak up the spare cycles
+// without delaying the live channels.
+//
+// With the PINNED placement, each worker is pinned to a CPU and runs its
+// own share of the channels: the decoder of a channel built by
+// add_channel() with a factory, its queue and its squelch are then
+// allocated by that worker, so that they are on its NUMA node (see
+// navtex_placement.h), and the channels of a group (fed from the same
+// input, say) are all given to the same worker.
+class channel_host {
+public:
+    enum priority { REALTIME, BACKGROUND };
+    // From the most to the least expensive: the normal decoder, the
+    // compact decoder, and the compact decoder behind a squelch, which
+    // skips the blocks without signal activity (see navtex_activity.h)
+    enum engine { FULL, REDUCED, MONITOR };
+    // FLOATING: any worker runs any channel, wherever the system puts it;
+    // PINNED: see above
+    enum placement { FLOATING, PINNED };
+    typedef std::function<navtex_rx * ()> rx_factory;
+
+    // queue_len: blocks each channel can have waiting
+    explicit channel_host(int nb_threads, int queue_len = 16);
+    ~channel_host();
+    channel_host(const channel_host &) = delete;
+    channel_host & operator=(const channel_host &) = delete;
+
+    // Add the channels before start(); returns the channel number. The
+    // decoder made by make_rx (when the host starts) belongs to the host.
+    // group: the channels of a group (>= 0) are run by the same worker
+    // with the PINNED placement
+    int add_channel(navtex_rx & rx, int sample_rate, priority prio = REALTIME,
+                    int group = -1);
+    int add_channel(rx_factory make_rx, int sample_rate, priority prio = REALTIME,
+                    int group = -1);
+    void set_placement(placement p) { m_placement = p; }
+    int nb_channels() const { return m_channels.size(); }
+    int sample_rate(int channel) const { return m_channels[channel]->sample_rate; }
+    priority channel_priority(int channel) const { return m_channels[channel]->prio; }
+    void start();
+    // Queue block for channel; the reference of the caller is handed over
+    // with it. When the queue is full, a real-time channel drops the block
+    // (an overrun, for which push() returns false: a live input cannot
+    // wait), while push() waits for room for a background channel.
+    bool push(int channel, sample_block * block);
+    // Wait until all the blocks queued have been processed, and stop the
+    // workers
+    void finish();
+
+    // Switch channel to another engine, before its next block
+    void set_engine(int channel, engine e);
+
+    channel_stats stats(int channel) const;
+    int nb_threads() const { return m_nb_threads; }
+    int queue_len() const { return m_queue_len; }
+    // with the PINNED placement, after start(): the worker running
+    // channel, and the CPU of worker (-1 when it could not be pinned)
+    int channel_worker(int channel) const { return m_channels[channel]->worker; }
+    int worker_cpu(int worker) const { return m_worker_cpus[worker]; }
+    // wall clock time the workers have spent decoding, all together, and
+    // decoding the channels of priority prio
+    double busy_seconds() const;
+    double busy_seconds(priority prio) const;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct entry {
+        sample_block * block;
+        clock::time_point pushed;
+        clock::time_point deadline;
+    };
+
+    struct channel {
+        navtex_rx * rx;
+        std::unique_ptr<navtex_rx> owned_rx;
+        rx_factory make_rx;
+        int sample_rate;
+        priority prio;
+        int group;
+        int worker;             // -1: any
+        int queue_len;
+        std::vector<entry> queue;
+        size_t head;
+        size_t count;
+        bool running;
+        engine current_engine;  // owned by the worker running the channel
+        engine next_engine;
+        std::unique_ptr<activity_scanner> squelch;
+        long long squelch_open_until;
+        channel_stats stats;
+
+        channel(navtex_rx * rx, rx_factory make_rx, int sample_rate, priority prio,
+                int group, int queue_len);
+        ~channel();
+        void build();
+        bool process(const sample_block * block, engine e);
+    };
+
+    int m_nb_threads;
+    int m_queue_len;
+    placement m_placement;
+    std::vector<int> m_worker_cpus;
+    int m_nb_ready;
+    std::vector<std::unique_ptr<channel>> m_channels;
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_room;
+    std::condition_variable m_ready;
+    long long m_queued;
+    bool m_finishing;
+    double m_busy_seconds[2];   // by priority
+
+    void assign_workers();
+    int next_channel(int worker) const;
+    void run(int worker);
+}; // channel_host
+
+#endif /* _NAVTEX_HOST_H */
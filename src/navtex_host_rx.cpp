@@ -0,0 +1,312 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// decode several NAVTEX sound files (signed LE16) at once, one channel
+// each, on a pool of worker threads scheduled by deadline (see
+// navtex_host.h): the real-time channels are replayed in real time (or
+// faster, with a jitter if asked), as a live input would be (see
+// navtex_replay.h), and the background channels as fast as the spare
+// cycles allow; at the end the CPU use, the queueing delays and the
+// overruns of each channel are printed. With --overload, idle channels
+// are moved to cheaper engines while the CPU runs short (see
+// navtex_overload.h); with --pin, the workers are pinned to CPUs, and the
+// channels of a file given more than once share a worker
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "navtex_fanout.h"
+#include "navtex_host.h"
+#include "navtex_overload.h"
+#include "navtex_placement.h"
+#include "navtex_replay.h"
+#include "navtex_rx.h"
+
+constexpr int default_block_size = 2048;
+constexpr int default_queue_len = 16;
+
+static std::mutex output_mutex;
+
+// navtex_rx that prints its messages with its name
+class labeled_rx : public navtex_rx {
+public:
+    labeled_rx(const std::string & name, int sample_rate) :
+        navtex_rx(sample_rate, false, false, nullptr, nullptr, stderr),
+        m_name(name) {}
+
+protected:
+    void put_received_message(const ccir_message & ccir_msg,
+                              const std::string & message) override {
+        (void) ccir_msg;
+        std::lock_guard<std::mutex> lock(output_mutex);
+        printf("[%s] %s\n", m_name.c_str(), message.c_str());
+        fflush(stdout);
+    }
+
+private:
+    std::string m_name;
+};
+
+struct input {
+    std::string path;
+    channel_host::priority prio;
+    int fd;
+    std::unique_ptr<block_pool> pool;
+    int channel;
+    int source;                 // of the replay, for a real-time channel
+};
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate [bg:]file...\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -j, --threads=N  number of worker threads (default: number of CPUs)\n");
+    fprintf(stderr, "  -q, --queue=N    blocks each channel can have waiting (default: %d)\n",
+            default_queue_len);
+    fprintf(stderr, "  -b, --block=N    samples per block (default: %d)\n", default_block_size);
+    fprintf(stderr, "  -o, --overload   degrade idle channels to cheaper engines when the\n");
+    fprintf(stderr, "                   CPU runs short (the changes are logged)\n");
+    fprintf(stderr, "  -p, --pin        pin the workers to CPUs, each with its channels\n");
+    fprintf(stderr, "                   allocated on its NUMA node\n");
+    fprintf(stderr, "  -s, --speed=X    replay the real-time channels X times faster than\n");
+    fprintf(stderr, "                   real time (default: 1)\n");
+    fprintf(stderr, "  -J, --jitter=MS  delay each block of a real-time channel by a random\n");
+    fprintf(stderr, "                   time of up to MS milliseconds (default: 0)\n");
+    fprintf(stderr, "  -S, --seed=N     seed of the random delays (default: 0)\n");
+    fprintf(stderr, "  -r, --repeat=N   play each file N times over (default: 1)\n");
+    fprintf(stderr, "  -h, --help       show this help\n");
+    fprintf(stderr, "The files are real-time channels, fed in real time, except the ones\n");
+    fprintf(stderr, "prefixed with 'bg:', which are background channels fed as fast as\n");
+    fprintf(stderr, "they are decoded.\n");
+}
+
+// feed a background channel as fast as it is decoded
+static void feed(channel_host & host, input & in, int repeat)
+{
+    long long position = 0;
+    while (repeat > 0) {
+        sample_block * block = in.pool->acquire();
+        ssize_t nread = read(in.fd, block->data(), block->capacity() * sizeof(short));
+        if (nread <= 0) {
+            block->release();
+            if (nread < 0) {
+                fprintf(stderr, "read(%s) failed: %s\n", in.path.c_str(), strerror(errno));
+                break;
+            }
+            if (--repeat > 0 && lseek(in.fd, 0, SEEK_SET) == -1)
+                break;
+            continue;
+        }
+        int nb_samples = nread / sizeof(short);
+        block->set_size(nb_samples);
+        block->set_position(position);
+        position += nb_samples;
+        host.push(in.channel, block);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int nb_threads = std::thread::hardware_concurrency();
+    int queue_len = default_queue_len;
+    int block_size = default_block_size;
+    bool overload = false;
+    bool pin = false;
+    double speed = 1;
+    double jitter = 0;
+    unsigned seed = 0;
+    int repeat = 1;
+
+    static const struct option long_options[] = {
+        { "threads", required_argument, nullptr, 'j' },
+        { "queue",   required_argument, nullptr, 'q' },
+        { "block",   required_argument, nullptr, 'b' },
+        { "overload", no_argument,      nullptr, 'o' },
+        { "pin",     no_argument,       nullptr, 'p' },
+        { "speed",   required_argument, nullptr, 's' },
+        { "jitter",  required_argument, nullptr, 'J' },
+        { "seed",    required_argument, nullptr, 'S' },
+        { "repeat",  required_argument, nullptr, 'r' },
+        { "help",    no_argument,       nullptr, 'h' },
+        { nullptr,   0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:q:b:ops:J:S:r:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'j':
+            if (sscanf(optarg, "%d", &nb_threads) != 1 || nb_threads <= 0) {
+                fprintf(stderr, "invalid number of threads: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'q':
+            if (sscanf(optarg, "%d", &queue_len) != 1 || queue_len <= 0) {
+                fprintf(stderr, "invalid queue length: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            if (sscanf(optarg, "%d", &block_size) != 1 || block_size <= 0) {
+                fprintf(stderr, "invalid block size: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'o':
+            overload = true;
+            break;
+        case 'p':
+            pin = true;
+            break;
+        case 's':
+            if (sscanf(optarg, "%lf", &speed) != 1 || speed <= 0) {
+                fprintf(stderr, "invalid speed: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'J':
+            if (sscanf(optarg, "%lf", &jitter) != 1 || jitter < 0) {
+                fprintf(stderr, "invalid jitter: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            jitter /= 1000;
+            break;
+        case 'S':
+            if (sscanf(optarg, "%u", &seed) != 1) {
+                fprintf(stderr, "invalid seed: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            if (sscanf(optarg, "%d", &repeat) != 1 || repeat <= 0) {
+                fprintf(stderr, "invalid repeat count: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int nargs = argc - optind;
+    char ** args = argv + optind;
+    if (nargs < 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int sample_rate;
+    if (sscanf(args[0], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", args[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    channel_host host(nb_threads, queue_len);
+    if (pin)
+        host.set_placement(channel_host::PINNED);
+    paced_replay replay(host, stderr);
+    replay.speed = speed;
+    replay.block_size = block_size;
+    replay.jitter = jitter;
+    replay.seed = seed;
+    std::vector<input> inputs(nargs - 1);
+    std::map<std::string, int> groups;
+    for (int i = 1; i < nargs; i++) {
+        input & in = inputs[i - 1];
+        in.path = args[i];
+        in.prio = channel_host::REALTIME;
+        if (in.path.compare(0, 3, "bg:") == 0) {
+            in.path.erase(0, 3);
+            in.prio = channel_host::BACKGROUND;
+        }
+        in.fd = open(in.path.c_str(), O_RDONLY);
+        if (in.fd == -1) {
+            fprintf(stderr, "open(%s) failed: %s\n", in.path.c_str(), strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        int group = groups.emplace(in.path, groups.size()).first->second;
+        std::string name = in.path;
+        in.channel = host.add_channel([name, sample_rate]() {
+                                          return new labeled_rx(name, sample_rate);
+                                      },
+                                      sample_rate, in.prio, group);
+        in.source = -1;
+        if (in.prio == channel_host::REALTIME) {
+            in.source = replay.add_source(in.fd, in.channel, repeat);
+        } else {
+            // enough blocks for a full queue, plus the ones being filled
+            // and decoded
+            in.pool.reset(new block_pool(block_size, queue_len + 2));
+        }
+    }
+
+    host.start();
+    if (pin) {
+        for (int t = 0; t < nb_threads; t++) {
+            int cpu = host.worker_cpu(t);
+            int nb_channels = 0;
+            for (input & in : inputs)
+                nb_channels += host.channel_worker(in.channel) == t;
+            if (cpu == -1)
+                fprintf(stderr, "worker %d: not pinned, %d channels\n", t, nb_channels);
+            else
+                fprintf(stderr, "worker %d: CPU %d (node %d), %d channels\n", t, cpu,
+                        cpu_node(cpu), nb_channels);
+        }
+    }
+    overload_controller controller(host, stderr);
+    if (overload)
+        controller.start();
+    std::vector<std::thread> feeders;
+    for (input & in : inputs)
+        if (in.prio == channel_host::BACKGROUND)
+            feeders.emplace_back(feed, std::ref(host), std::ref(in), repeat);
+    replay.run();
+    for (std::thread & feeder : feeders)
+        feeder.join();
+    controller.stop();
+    host.finish();
+
+    printf("channel  class       seconds  CPU (s)  load (%%)  max late (ms)  max queue  max delay (ms)  overruns  dropped (s)  reduced (s)  monitor (s)\n");
+    for (input & in : inputs) {
+        channel_stats stats = host.stats(in.channel);
+        double seconds = (double) stats.samples / sample_rate;
+        // how late the replay pushed the blocks
+        double late = 0;
+        if (in.source != -1) {
+            replay_stats replayed = replay.stats(in.source);
+            late = replayed.max_late;
+            if (replayed.error != 0)
+                fprintf(stderr, "read(%s) failed: %s\n", in.path.c_str(),
+                        strerror(replayed.error));
+        }
+        printf("%7d  %-10s  %7.1f  %7.2f  %8.2f  %13.1f  %9d  %14.1f  %8lld  %11.1f  %11.1f  %11.1f  %s\n",
+               in.channel, in.prio == channel_host::REALTIME ? "realtime" : "background",
+               seconds, stats.cpu_seconds,
+               seconds > 0 ? 100 * stats.cpu_seconds / seconds : 0.0, 1000 * late,
+               stats.max_queue, 1000 * stats.max_delay, stats.overruns,
+               (double) stats.dropped_samples / sample_rate,
+               (double) stats.engine_samples[channel_host::REDUCED] / sample_rate,
+               (double) stats.engine_samples[channel_host::MONITOR] / sample_rate,
+               in.path.c_str());
+        close(in.fd);
+    }
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_index.h"
+#include "navtex_rx.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// navtex_rx that records where it locks and where it finds headers
+class index_rx : public navtex_rx {
+public:
+    index_rx(int sample_rate, bool reverse, recording_index & index) :
+        navtex_rx(sample_rate, false, reverse, nullptr, nullptr, nullptr),
+        m_index(index), m_locked(false), m_lock_start(0) {}
+
+    void finish() override {
+        navtex_rx::finish();
+        if (m_locked)
+            m_index.sync.push_back({ m_lock_start, input_position() });
+        m_locked = false;
+    }
+
+protected:
+    void sync_changed(bool locked) override {
+        if (locked) {
+            m_lock_start = input_position();
+        } else if (m_locked) {
+            m_index.sync.push_back({ m_lock_start, input_position() });
+        }
+        m_locked = locked;
+    }
+
+    void header_detected(const ccir_message & header) override {
+        long long margin = (long long) recording_index::warm_up_margin *
+                           m_index.sample_rate;
+        long long start = m_locked ? m_lock_start : input_position();
+        m_index.headers.push_back({ input_position(), header.origin(),
+                                    header.subject(), header.number(),
+                                    std::max(0LL, start - margin) });
+    }
+
+private:
+    recording_index & m_index;
+    bool m_locked;
+    long long m_lock_start;
+};
+
+} // namespace
+
+recording_index::recording_index() :
+    sample_rate(0),
+    nb_samples(0) {
+}
+
+void recording_index::build(const short * data, long long nb_samples,
+                            int sample_rate, bool reverse) {
+    this->sample_rate = sample_rate;
+    this->nb_samples = nb_samples;
+    activity_scanner scanner(sample_rate);
+    activity = scanner.scan(data, nb_samples);
+    sync.clear();
+    headers.clear();
+
+    index_rx rx(sample_rate, reverse, *this);
+    decode_regions(rx, data, activity);
+    rx.finish();
+}
+
+std::string recording_index::sidecar_path(const std::string & recording) {
+    return recording + ".idx";
+}
+
+bool recording_index::save(const std::string & path) const {
+    FILE * f = fopen(path.c_str(), "w");
+    if (f == nullptr)
+        return false;
+    fprintf(f, "NAVTEX-INDEX 1\n");
+    fprintf(f, "sample_rate %d\n", sample_rate);
+    fprintf(f, "samples %lld\n", nb_samples);
+    for (const activity_region & r : activity)
+        fprintf(f, "activity %lld %lld\n", r.start, r.end);
+    for (const activity_region & r : sync)
+        fprintf(f, "sync %lld %lld\n", r.start, r.end);
+    for (const index_header & h : headers)
+        fprintf(f, "header %lld %c%c%02d %lld\n", h.sample, h.origin,
+                h.subject, h.number, h.resume);
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+const index_header * recording_index::find_header(const std::string & id) const {
+    for (const index_header & h : headers) {
+        char header_id[8];
+        snprintf(header_id, sizeof(header_id), "%c%c%02u", h.origin, h.subject,
+                 (unsigned) h.number % 100);
+        if (id == header_id)
+            return &h;
+    }
+    return nullptr;
+}
+
+bool recording_index::load(const std::string & path) {
+    FILE * f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return false;
+    activity.clear();
+    sync.clear();
+    headers.clear();
+
+    int version = 0;
+    bool ok = fscanf(f, "NAVTEX-INDEX %d\n", &version) == 1 && version == 1;
+    char line[256];
+    while (ok && fgets(line, sizeof(line), f) != nullptr) {
+        char key[32];
+        long long a, b;
+        index_header h;
+        if (sscanf(line, "%31s", key) != 1)
+            continue;
+        if (strcmp(key, "sample_rate") == 0) {
+            ok = sscanf(line, "%*s %d", &sample_rate) == 1;
+        } else if (strcmp(key, "samples") == 0) {
+            ok = sscanf(line, "%*s %lld", &nb_samples) == 1;
+        } else if (strcmp(key, "activity") == 0) {
+            ok = sscanf(line, "%*s %lld %lld", &a, &b) == 2;
+            if (ok)
+                activity.push_back({ a, b });
+        } else if (strcmp(key, "sync") == 0) {
+            ok = sscanf(line, "%*s %lld %lld", &a, &b) == 2;
+            if (ok)
+                sync.push_back({ a, b });
+        } else if (strcmp(key, "header") == 0) {
+            ok = sscanf(line, "%*s %lld %c%c%2d %lld", &h.sample, &h.origin,
+                        &h.subject, &h.number, &h.resume) == 5;
+            if (ok)
+                headers.push_back(h);
+        }
+        // unknown keys are ignored, for forward compatibility
+    }
+    fclose(f);
+    return ok;
+}
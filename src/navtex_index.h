@@ -0,0 +1,68 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_INDEX_H
+#define _NAVTEX_INDEX_H
+
+#include "navtex_activity.h"
+#include <string>
+#include <vector>
+
+// A ZCZC header found in a recording
+struct index_header {
+    long long sample;       // input sample where the header was decoded
+    char origin;            // B1
+    char subject;           // B2
+    int number;             // B3B4
+    // Where to resume decoding to get this message: the start of the
+    // sync lock interval containing the header, less a warm-up margin,
+    // so that a decoder positioned there with skip_samples() has settled
+    // by the time the message starts
+    long long resume;
+};
+
+// Sidecar index of a recording: where the activity, the sync lock
+// intervals and the message headers are. Later decodes can go straight
+// to the relevant regions instead of starting from sample zero.
+//
+// The sidecar is a small text file:
+//   NAVTEX-INDEX 1
+//   sample_rate <rate>
+//   samples <count>
+//   activity <start> <end>
+//   sync <start> <end>
+//   header <sample> <B1B2B3B4> <resume>
+class recording_index {
+public:
+    recording_index();
+
+    // Index data with the activity scanner and a decode of the active
+    // regions
+    void build(const short * data, long long nb_samples, int sample_rate,
+               bool reverse = false);
+
+    bool save(const std::string & path) const;
+    bool load(const std::string & path);
+
+    // the first header of message id (B1B2B3B4, for instance "EE39"), or
+    // nullptr if there is none
+    const index_header * find_header(const std::string & id) const;
+
+    // sidecar file name for a recording
+    static std::string sidecar_path(const std::string & recording);
+
+    int sample_rate;
+    long long nb_samples;
+    std::vector<activity_region> activity;
+    std::vector<activity_region> sync;
+    std::vector<index_header> headers;
+
+    // signal needed before a sync interval for the decoder to settle (s)
+    static const int warm_up_margin = 20;
+}; // recording_index
+
+#endif /* _NAVTEX_INDEX_H */
@@ -0,0 +1,102 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_merge.h"
+#include <climits>
+#include <cstdio>
+
+message_merge::message_merge(const std::vector<source> & inputs, double window,
+                             bool dedupe) :
+    m_inputs(inputs.size()),
+    m_window(window),
+    m_dedupe(dedupe),
+    m_last_time(LLONG_MIN),
+    m_started(false),
+    m_duplicates(0),
+    m_late(0) {
+    for (size_t i = 0; i < inputs.size(); i++) {
+        m_inputs[i].read = inputs[i];
+        m_inputs[i].latest = LLONG_MIN;
+        m_inputs[i].seq = 0;
+        m_inputs[i].finished = false;
+    }
+}
+
+// No message read later from in can come before its first one
+bool message_merge::ready(const input & in) const {
+    return in.finished ||
+           (!in.pending.empty() && in.pending.top().time <= in.latest - m_window);
+}
+
+// Read input i until its first message is ready, and put it in the heads
+void message_merge::fill(int i) {
+    input & in = m_inputs[i];
+    while (!ready(in)) {
+        timed_message message;
+        if (!in.read(message)) {
+            in.finished = true;
+            break;
+        }
+        message.input = i;
+        message.seq = in.seq++;
+        if (message.time > in.latest)
+            in.latest = message.time;
+        in.pending.push(std::move(message));
+    }
+    if (!in.pending.empty())
+        m_heads.emplace(in.pending.top().time, i, in.pending.top().seq);
+}
+
+bool message_merge::duplicate(const timed_message & message) {
+    // forget the messages that are out of the window
+    while (!m_recent.empty() && m_recent.front().first < message.time - m_window) {
+        auto key = m_recent_keys.find(m_recent.front().second);
+        if (--key->second == 0)
+            m_recent_keys.erase(key);
+        m_recent.pop_front();
+    }
+    std::string key;
+    if (message.origin != '?' && message.subject != '?' && message.number != 0) {
+        char id[16];
+        snprintf(id, sizeof(id), "#%c%c%02d", message.origin, message.subject,
+                 message.number);
+        key = id;
+    } else {
+        key = "=" + message.text;
+    }
+    if (m_recent_keys.count(key) != 0)
+        return true;
+    m_recent.emplace_back(message.time, key);
+    m_recent_keys[key]++;
+    return false;
+}
+
+bool message_merge::next(timed_message & message) {
+    if (!m_started) {
+        for (size_t i = 0; i < m_inputs.size(); i++)
+            fill(i);
+        m_started = true;
+    }
+    while (!m_heads.empty()) {
+        int i = std::get<1>(m_heads.top());
+        m_heads.pop();
+        input & in = m_inputs[i];
+        message = in.pending.top();
+        in.pending.pop();
+        fill(i);
+        if (message.time < m_last_time)
+            m_late++;
+        else
+            m_last_time = message.time;
+        if (m_dedupe && duplicate(message)) {
+            m_duplicates++;
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
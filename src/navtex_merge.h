@@ -0,0 +1,105 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_MERGE_H
+#define _NAVTEX_MERGE_H
+
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// A message of a stream, as on the message bus (see navtex_bus.h)
+struct timed_message {
+    long long time;             // wall clock time when it was published
+    unsigned channel;
+    char origin;                // B1 ('?' if unknown)
+    char subject;               // B2 ('?' if unknown)
+    int number;                 // B3B4
+    long long sample;
+    std::string text;
+    // set by message_merge
+    int input;
+    long long seq;              // position in its input
+};
+
+// Streaming k-way merge of message streams (several channels, files or
+// buses) into one stream in time order. Each input is in time order,
+// give or take window seconds: the messages of an input wait in a reorder
+// buffer until the input has gone window seconds past them, and a heap
+// of the first message of each input picks the next one, so that a
+// message costs O(log k) for k inputs, plus O(log n) for the n messages
+// of its input within the window, which is all that is kept in memory.
+// Messages with the same time come out in the order of their inputs.
+//
+// The duplicates (the same message received on several channels) within
+// window seconds of each other are dropped, the first one being kept: two
+// messages are the same if they have the same B1B2B3B4, or, when it is
+// unknown or B3B4 is 00 (which receivers never suppress), the same text.
+class message_merge {
+public:
+    // Reads the next message of an input; false at the end of the input
+    typedef std::function<bool (timed_message &)> source;
+
+    message_merge(const std::vector<source> & inputs, double window,
+                  bool dedupe = true);
+    message_merge(const message_merge &) = delete;
+    message_merge & operator=(const message_merge &) = delete;
+
+    // The next message in time order, reading the inputs as needed; false
+    // when they are all finished
+    bool next(timed_message & message);
+
+    long long duplicates() const { return m_duplicates; }
+    // messages that came more than window seconds late in their input,
+    // and so out of order
+    long long late() const { return m_late; }
+
+private:
+    struct later {
+        bool operator()(const timed_message & a, const timed_message & b) const {
+            if (a.time != b.time)
+                return a.time > b.time;
+            if (a.input != b.input)
+                return a.input > b.input;
+            return a.seq > b.seq;
+        }
+    };
+    typedef std::priority_queue<timed_message, std::vector<timed_message>, later> buffer;
+    // time, input and seq of the first message of an input
+    typedef std::tuple<long long, int, long long> head;
+
+    struct input {
+        source read;
+        buffer pending;
+        long long latest;       // latest time read
+        long long seq;
+        bool finished;
+    };
+
+    void fill(int i);
+    bool ready(const input & in) const;
+    bool duplicate(const timed_message & message);
+
+    std::vector<input> m_inputs;
+    double m_window;
+    bool m_dedupe;
+    // the first message of each input that has one
+    std::priority_queue<head, std::vector<head>, std::greater<head>> m_heads;
+    // the messages emitted within the window, for the duplicates
+    std::deque<std::pair<long long, std::string>> m_recent;
+    std::unordered_map<std::string, int> m_recent_keys;
+    long long m_last_time;
+    bool m_started;
+    long long m_duplicates;
+    long long m_late;
+}; // message_merge
+
+#endif /* _NAVTEX_MERGE_H */
@@ -0,0 +1,189 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// merge the message streams printed by navtex_bus_reader (for instance
+// one per receiver, from files or pipes) into one stream in time order,
+// without the duplicates (see navtex_merge.h); the output is in the same
+// format, so that it can be merged again
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <getopt.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "navtex_merge.h"
+
+constexpr double default_window = 10;
+
+// Reads the messages of a stream in the navtex_bus_reader format: a
+// header line, then the text of the message and a newline
+class message_reader {
+public:
+    message_reader(const char * path, FILE * file) :
+        m_path(path), m_file(file), m_line(nullptr), m_size(0), m_have_header(false) {}
+    ~message_reader() {
+        free(m_line);
+        if (m_file != stdin)
+            fclose(m_file);
+    }
+
+    bool read(timed_message & message) {
+        // up to the first header
+        while (!m_have_header) {
+            if (!next_line())
+                return false;
+            m_have_header = parse_header(m_header);
+        }
+        message = m_header;
+        message.text.clear();
+        m_have_header = false;
+        while (next_line()) {
+            m_have_header = parse_header(m_header);
+            if (m_have_header)
+                break;
+            message.text.append(m_line, m_length);
+        }
+        // the newline after the text
+        if (!message.text.empty() && message.text.back() == '\n')
+            message.text.pop_back();
+        return true;
+    }
+
+private:
+    bool next_line() {
+        m_length = getline(&m_line, &m_size, m_file);
+        if (m_length < 0 && ferror(m_file))
+            fprintf(stderr, "cannot read %s: %s\n", m_path, strerror(errno));
+        return m_length >= 0;
+    }
+
+    bool parse_header(timed_message & message) const {
+        char timestamp[32];
+        char origin, subject;
+        int number;
+        long long sample;
+        int end = -1;
+        if (sscanf(m_line, "--- %31s channel %u %c%c%2d sample %lld%n", timestamp,
+                   &message.channel, &origin, &subject, &number, &sample, &end) != 6 ||
+            (m_line[end] != '\n' && m_line[end] != '\0'))
+            return false;
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char * rest = strptime(timestamp, "%Y-%m-%dT%H:%M:%SZ", &tm);
+        if (rest == nullptr || *rest != '\0')
+            return false;
+        message.time = timegm(&tm);
+        message.origin = origin;
+        message.subject = subject;
+        message.number = number;
+        message.sample = sample;
+        return true;
+    }
+
+    const char * m_path;
+    FILE * m_file;
+    char * m_line;
+    size_t m_size;
+    ssize_t m_length;
+    bool m_have_header;
+    timed_message m_header;
+};
+
+static void print_message(const timed_message & message)
+{
+    char timestamp[32];
+    time_t t = message.time;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    printf("--- %s channel %u %c%c%02u sample %lld\n", timestamp,
+           message.channel, message.origin, message.subject, message.number,
+           message.sample);
+    fwrite(message.text.data(), 1, message.text.size(), stdout);
+    putchar('\n');
+}
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] file|-...\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -w, --window=S           seconds a message can come late in its input,\n");
+    fprintf(stderr, "                           and between duplicates (default: %g)\n",
+            default_window);
+    fprintf(stderr, "  -k, --keep-duplicates    keep the duplicates\n");
+    fprintf(stderr, "  -h, --help               show this help\n");
+}
+
+int main(int argc, char** argv)
+{
+    double window = default_window;
+    bool dedupe = true;
+
+    static const struct option long_options[] = {
+        { "window",          required_argument, nullptr, 'w' },
+        { "keep-duplicates", no_argument,       nullptr, 'k' },
+        { "help",            no_argument,       nullptr, 'h' },
+        { nullptr,           0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "w:kh", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'w':
+            if (sscanf(optarg, "%lf", &window) != 1 || window < 0) {
+                fprintf(stderr, "invalid window: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'k':
+            dedupe = false;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::unique_ptr<message_reader>> readers;
+    std::vector<message_merge::source> sources;
+    for (int i = optind; i < argc; i++) {
+        FILE * file = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+        if (file == nullptr) {
+            fprintf(stderr, "fopen(%s) failed: %s\n", argv[i], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        readers.emplace_back(new message_reader(argv[i], file));
+        message_reader * reader = readers.back().get();
+        sources.push_back([reader](timed_message & message) {
+                              return reader->read(message);
+                          });
+    }
+
+    message_merge merge(sources, window, dedupe);
+    timed_message message;
+    long long nb_messages = 0;
+    while (merge.next(message)) {
+        print_message(message);
+        // the inputs can be live, from navtex_bus_reader
+        fflush(stdout);
+        nb_messages++;
+    }
+    fprintf(stderr, "%lld messages, %lld duplicates dropped, %lld out of order\n",
+            nb_messages, merge.duplicates(), merge.late());
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_multichannel.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static bool read_all(int fd, void * buffer, size_t size) {
+    char * p = static_cast<char *>(buffer);
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static uint32_t le32(const unsigned char * p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t le16(const unsigned char * p) {
+    return p[0] | (p[1] << 8);
+}
+
+bool read_wav_header(int fd, wav_format & format) {
+    unsigned char riff[12];
+    if (!read_all(fd, riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) != 0 ||
+        memcmp(riff + 8, "WAVE", 4) != 0)
+        return false;
+    bool have_format = false;
+    for (;;) {
+        unsigned char chunk[8];
+        if (!read_all(fd, chunk, sizeof(chunk)))
+            return false;
+        uint32_t size = le32(chunk + 4);
+        if (memcmp(chunk, "data", 4) == 0) {
+            // recorders that stream the file leave the size at 0 or ~0
+            format.data_size = size == 0 || size == 0xffffffff ? -1 : size;
+            return have_format;
+        }
+        // the chunks are padded to an even size
+        uint64_t padded = size + (size & 1);
+        if (memcmp(chunk, "fmt ", 4) != 0 || size < 16 || size > 64) {
+            unsigned char skipped[4096];
+            while (padded > 0) {
+                size_t n = padded < sizeof(skipped) ? padded : sizeof(skipped);
+                if (!read_all(fd, skipped, n))
+                    return false;
+                padded -= n;
+            }
+            continue;
+        }
+        unsigned char fmt[64];
+        if (!read_all(fd, fmt, padded))
+            return false;
+        uint16_t tag = le16(fmt);
+        // WAVE_FORMAT_EXTENSIBLE: the format is the start of the sub format
+        if (tag == 0xfffe && size >= 26)
+            tag = le16(fmt + 24);
+        format.nb_channels = le16(fmt + 2);
+        format.sample_rate = le32(fmt + 4);
+        format.bits_per_sample = le16(fmt + 14);
+        have_format = tag == 1 && format.bits_per_sample == 16 && format.nb_channels > 0 &&
+                      format.sample_rate > 0;
+        if (!have_format)
+            return false;
+    }
+}
+
+#ifdef __SSE2__
+// 8 frames of 2 channels in 2 registers
+static void deinterleave2(const short * in, short * a, short * b) {
+    __m128i r0 = _mm_loadu_si128((const __m128i *) in);
+    __m128i r1 = _mm_loadu_si128((const __m128i *) in + 1);
+    __m128i t0 = _mm_unpacklo_epi16(r0, r1);    // a0 a4 b0 b4 a1 a5 b1 b5
+    __m128i t1 = _mm_unpackhi_epi16(r0, r1);    // a2 a6 b2 b6 a3 a7 b3 b7
+    __m128i u0 = _mm_unpacklo_epi16(t0, t1);    // a0 a2 a4 a6 b0 b2 b4 b6
+    __m128i u1 = _mm_unpackhi_epi16(t0, t1);    // a1 a3 a5 a7 b1 b3 b5 b7
+    _mm_storeu_si128((__m128i *) a, _mm_unpacklo_epi16(u0, u1));
+    _mm_storeu_si128((__m128i *) b, _mm_unpackhi_epi16(u0, u1));
+}
+
+// 8 frames of 4 channels in 4 registers
+static void deinterleave4(const short * in, short * const * out, int offset) {
+    __m128i r0 = _mm_loadu_si128((const __m128i *) in);
+    __m128i r1 = _mm_loadu_si128((const __m128i *) in + 1);
+    __m128i r2 = _mm_loadu_si128((const __m128i *) in + 2);
+    __m128i r3 = _mm_loadu_si128((const __m128i *) in + 3);
+    __m128i t0 = _mm_unpacklo_epi16(r0, r1);    // a0 a2 b0 b2 c0 c2 d0 d2
+    __m128i t1 = _mm_unpackhi_epi16(r0, r1);    // a1 a3 b1 b3 c1 c3 d1 d3
+    __m128i t2 = _mm_unpacklo_epi16(r2, r3);
+    __m128i t3 = _mm_unpackhi_epi16(r2, r3);
+    __m128i u0 = _mm_unpacklo_epi16(t0, t1);    // a0 a1 a2 a3 b0 b1 b2 b3
+    __m128i u1 = _mm_unpackhi_epi16(t0, t1);    // c0 c1 c2 c3 d0 d1 d2 d3
+    __m128i u2 = _mm_unpacklo_epi16(t2, t3);    // a4 .. a7 b4 .. b7
+    __m128i u3 = _mm_unpackhi_epi16(t2, t3);    // c4 .. c7 d4 .. d7
+    _mm_storeu_si128((__m128i *) (out[0] + offset), _mm_unpacklo_epi64(u0, u2));
+    _mm_storeu_si128((__m128i *) (out[1] + offset), _mm_unpackhi_epi64(u0, u2));
+    _mm_storeu_si128((__m128i *) (out[2] + offset), _mm_unpacklo_epi64(u1, u3));
+    _mm_storeu_si128((__m128i *) (out[3] + offset), _mm_unpackhi_epi64(u1, u3));
+}
+
+// 8 frames of 8 channels in 8 registers (an 8 x 8 transpose)
+static void deinterleave8(const short * in, short * const * out, int offset) {
+    __m128i r[8], t[8], u[8];
+    for (int i = 0; i < 8; i++)
+        r[i] = _mm_loadu_si128((const __m128i *) in + i);
+    for (int i = 0; i < 4; i++) {
+        t[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);     // a b c d of 2 frames
+        t[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]); // e f g h
+    }
+    for (int i = 0; i < 2; i++) {
+        u[4 * i] = _mm_unpacklo_epi32(t[4 * i], t[4 * i + 2]);     // a b of 4 frames
+        u[4 * i + 1] = _mm_unpackhi_epi32(t[4 * i], t[4 * i + 2]); // c d
+        u[4 * i + 2] = _mm_unpacklo_epi32(t[4 * i + 1], t[4 * i + 3]); // e f
+        u[4 * i + 3] = _mm_unpackhi_epi32(t[4 * i + 1], t[4 * i + 3]); // g h
+    }
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i *) (out[2 * i] + offset), _mm_unpacklo_epi64(u[i], u[i + 4]));
+        _mm_storeu_si128((__m128i *) (out[2 * i + 1] + offset), _mm_unpackhi_epi64(u[i], u[i + 4]));
+    }
+}
+#endif
+
+void deinterleave(const short * frames, int nb_frames, int nb_channels,
+                  short * const * channels) {
+    int i = 0;
+#ifdef __SSE2__
+    if (nb_channels == 2) {
+        for (; i + 8 <= nb_frames; i += 8)
+            deinterleave2(frames + 2 * i, channels[0] + i, channels[1] + i);
+    } else if (nb_channels == 4) {
+        for (; i + 8 <= nb_frames; i += 8)
+            deinterleave4(frames + 4 * i, channels, i);
+    } else if (nb_channels == 8) {
+        for (; i + 8 <= nb_frames; i += 8)
+            deinterleave8(frames + 8 * i, channels, i);
+    }
+#endif
+    for (; i < nb_frames; i++)
+        for (int c = 0; c < nb_channels; c++)
+            channels[c][i] = frames[(long long) i * nb_channels + c];
+}
@@ -0,0 +1,34 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_MULTICHANNEL_H
+#define _NAVTEX_MULTICHANNEL_H
+
+// Multichannel recordings: capture cards that record several receivers
+// into one file interleave their samples, one frame (a sample of each
+// channel) after the other.
+
+// Format of a WAV file, from its header
+struct wav_format {
+    int sample_rate;
+    int nb_channels;
+    int bits_per_sample;
+    long long data_size;        // bytes of samples (-1: up to the end)
+};
+
+// Read the header of the WAV file open on fd, up to the start of the
+// samples, without seeking (fd can be a pipe); returns false if it is
+// not a WAV file of 16 bit PCM samples
+bool read_wav_header(int fd, wav_format & format);
+
+// Split nb_frames frames of nb_channels interleaved samples into one
+// buffer per channel. The usual layouts (2, 4 and 8 channels) go through
+// SSE2 transposes, 8 frames at a time.
+void deinterleave(const short * frames, int nb_frames, int nb_channels,
+                  short * const * channels);
+
+#endif /* _NAVTEX_MULTICHANNEL_H */
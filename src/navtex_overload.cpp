@@ -0,0 +1,170 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_host.h"
+#include "navtex_overload.h"
+#include <algorithm>
+#include <chrono>
+
+static const char * engine_names[] = { "full", "reduced", "monitor" };
+
+static double now_seconds() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+overload_controller::overload_controller(channel_host & host, FILE * log) :
+    low_headroom(0.15),
+    high_headroom(0.35),
+    min_idle(30),
+    min_dwell(10),
+    interval(1),
+    m_host(host),
+    m_log(log),
+    m_start(0),
+    m_last_time(0),
+    m_last_busy(0),
+    m_last_overruns(0),
+    m_headroom(1),
+    m_stopping(false) {
+}
+
+overload_controller::~overload_controller() {
+    stop();
+}
+
+void overload_controller::start() {
+    int nb_channels = m_host.nb_channels();
+    // a channel is never given a better engine than the one it started with
+    m_base_engine.resize(nb_channels);
+    m_last_change.assign(nb_channels, -min_dwell);
+    m_last_overruns = 0;
+    for (int i = 0; i < nb_channels; i++) {
+        channel_stats stats = m_host.stats(i);
+        m_base_engine[i] = stats.requested_engine;
+        m_last_overruns += stats.overruns;
+    }
+    m_start = now_seconds();
+    m_last_time = 0;
+    m_last_busy = m_host.busy_seconds(channel_host::REALTIME);
+    m_stopping = false;
+    m_thread = std::thread(&overload_controller::run, this);
+}
+
+void overload_controller::stop() {
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_one();
+    m_thread.join();
+}
+
+void overload_controller::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        m_wakeup.wait_for(lock, std::chrono::duration<double>(interval));
+        if (m_stopping)
+            break;
+        lock.unlock();
+        update();
+        lock.lock();
+    }
+}
+
+void overload_controller::update() {
+    double now = now_seconds() - m_start;
+    double busy = m_host.busy_seconds(channel_host::REALTIME);
+    int nb_channels = m_host.nb_channels();
+    std::vector<channel_stats> stats(nb_channels);
+    long long overruns = 0;
+    for (int i = 0; i < nb_channels; i++) {
+        stats[i] = m_host.stats(i);
+        overruns += stats[i].overruns;
+    }
+    if (now <= m_last_time)
+        return;
+    double headroom = 1 - (busy - m_last_busy) / ((now - m_last_time) * m_host.nb_threads());
+    if (overruns > m_last_overruns)
+        headroom = 0;
+    headroom = std::max(headroom, 0.0);
+    m_last_time = now;
+    m_last_busy = busy;
+    m_last_overruns = overruns;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_headroom = headroom;
+    }
+
+    bool degrade = headroom < low_headroom;
+    bool restore = headroom > high_headroom;
+    if (!degrade && !restore)
+        return;
+
+    std::vector<int> candidates;
+    for (int i = 0; i < nb_channels; i++) {
+        if (now - m_last_change[i] < min_dwell)
+            continue;
+        const channel_stats & s = stats[i];
+        double idle = (double) s.idle_samples / m_host.sample_rate(i);
+        // the engine set last, which the channel may not have used yet
+        if (degrade && s.requested_engine < channel_host::MONITOR && !s.locked &&
+            idle >= min_idle)
+            candidates.push_back(i);
+        if (restore && s.requested_engine > m_base_engine[i])
+            candidates.push_back(i);
+    }
+    if (candidates.empty())
+        return;
+
+    // degrade the background channels first, and then the channels idle
+    // the longest; restore the real-time channels first, and then the
+    // channels with the most recent activity
+    std::stable_sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+        bool rt_a = m_host.channel_priority(a) == channel_host::REALTIME;
+        bool rt_b = m_host.channel_priority(b) == channel_host::REALTIME;
+        if (rt_a != rt_b)
+            return degrade ? !rt_a : rt_a;
+        return degrade ? stats[a].idle_samples > stats[b].idle_samples
+                       : stats[a].idle_samples < stats[b].idle_samples;
+    });
+    // a quarter of them at a time, so that the effect can be measured
+    // before going further
+    size_t n = std::max((size_t) 1, candidates.size() / 4);
+    for (size_t k = 0; k < n; k++) {
+        int i = candidates[k];
+        int from = stats[i].requested_engine;
+        int to = degrade ? from + 1 : from - 1;
+        m_host.set_engine(i, (channel_host::engine) to);
+        change(i, from, to, now);
+    }
+}
+
+void overload_controller::change(int channel, int from, int to, double now) {
+    m_last_change[channel] = now;
+    double headroom;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        headroom = m_headroom;
+        m_events.push_back({ now, channel, from, to, headroom });
+    }
+    if (m_log != nullptr)
+        fprintf(m_log, "[%.1f s] headroom %.0f%%: channel %d %s -> %s\n", now,
+                100 * headroom, channel, engine_names[from], engine_names[to]);
+}
+
+std::vector<overload_controller::event> overload_controller::events() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_events;
+}
+
+double overload_controller::headroom() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_headroom;
+}
@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_OVERLOAD_H
+#define _NAVTEX_OVERLOAD_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class channel_host;
+
+// Graceful degradation of a channel_host when the CPU runs short: rather
+// than letting the real-time channels overrun at random, the controller
+// moves the channels that have not been locked on a signal for a while to
+// cheaper engines (compact decoder, then compact decoder behind a
+// squelch), a step at a time, while the headroom of the workers is below
+// low_headroom, and gives them back their engine, a step at a time,
+// while it is above high_headroom. The gap between the two thresholds
+// and the minimum time between two changes of a channel keep it from
+// flapping.
+//
+// The headroom is the fraction of the time the workers were not decoding
+// real-time channels over the last interval; it counts as zero when a
+// channel overran. The background channels take all the spare cycles by
+// design, so they do not count as load, but they are the first to be
+// degraded.
+class overload_controller {
+public:
+    // Every change of engine is logged to log, if not nullptr
+    explicit overload_controller(channel_host & host, FILE * log = nullptr);
+    ~overload_controller();
+    overload_controller(const overload_controller &) = delete;
+    overload_controller & operator=(const overload_controller &) = delete;
+
+    // Parameters, to be set before start()
+    double low_headroom;        // degrade below this headroom (0.15)
+    double high_headroom;       // restore above this headroom (0.35)
+    double min_idle;            // seconds of input without a lock before a
+                                // channel can be degraded (30)
+    double min_dwell;           // seconds between changes of a channel (10)
+    double interval;            // seconds between evaluations (1)
+
+    // Evaluate every interval seconds on a thread of its own, after the
+    // host has started; stop() before finishing the host
+    void start();
+    void stop();
+    // One evaluation, for callers that run their own loop
+    void update();
+
+    // A change of engine of a channel
+    struct event {
+        double time;            // seconds since start()
+        int channel;
+        int from;               // channel_host::engine
+        int to;
+        double headroom;
+    };
+    std::vector<event> events() const;
+    double headroom() const;
+
+private:
+    channel_host & m_host;
+    FILE * m_log;
+    std::vector<int> m_base_engine;
+    std::vector<double> m_last_change;
+    std::vector<event> m_events;
+    double m_start;
+    double m_last_time;
+    double m_last_busy;
+    long long m_last_overruns;
+    double m_headroom;
+    bool m_stopping;
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+
+    void run();
+    void change(int channel, int from, int to, double now);
+}; // overload_controller
+
+#endif /* _NAVTEX_OVERLOAD_H */
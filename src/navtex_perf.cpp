@@ -0,0 +1,120 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_perf.h"
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+    const char * name;
+    uint32_t type;
+    uint64_t config;
+} events[perf_counters::nb_events] = {
+    { "cycles",         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1D misses",     PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                            PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                                            PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+    { "LLC references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    { "LLC misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch misses",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+perf_counters::perf_counters() {
+    for (int e = 0; e < nb_events; e++) {
+        m_fds[e] = -1;
+        m_values[e] = -1;
+    }
+}
+
+perf_counters::~perf_counters() {
+    for (int e = 0; e < nb_events; e++)
+        if (m_fds[e] != -1)
+            close(m_fds[e]);
+}
+
+bool perf_counters::open() {
+    bool any = false;
+    for (int e = 0; e < nb_events; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[e].type;
+        attr.config = events[e].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        // user space only, which perf_event_paranoid allows by default
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        m_fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        any = any || m_fds[e] != -1;
+    }
+    return any;
+}
+
+void perf_counters::start() {
+    for (int e = 0; e < nb_events; e++) {
+        if (m_fds[e] == -1)
+            continue;
+        ioctl(m_fds[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_counters::stop() {
+    for (int e = 0; e < nb_events; e++) {
+        m_values[e] = -1;
+        if (m_fds[e] == -1)
+            continue;
+        ioctl(m_fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (read(m_fds[e], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+        // the kernel multiplexes the counters when there are more than
+        // the PMU has: extrapolate to the whole time
+        m_values[e] = data[2] < data[1] ? (long long) ((double) data[0] * data[1] / data[2])
+                                        : (long long) data[0];
+    }
+}
+
+const char * perf_counters::name(event e) {
+    return events[e].name;
+}
+
+bool perf_counters::available() const {
+    for (int e = 0; e < nb_events; e++)
+        if (m_values[e] >= 0)
+            return true;
+    return false;
+}
+
+void perf_counters::report(FILE * out, double nb_samples, double nb_characters,
+                           const char * indent) const {
+    fprintf(out, "%s%-16s  %16s  %12s  %14s\n", indent, "counter", "total",
+            "per sample", "per character");
+    for (int e = 0; e < nb_events; e++) {
+        long long value = m_values[e];
+        if (value < 0) {
+            fprintf(out, "%s%-16s  %16s\n", indent, events[e].name, "not available");
+            continue;
+        }
+        char per_character[32] = "-";
+        if (nb_characters > 0)
+            snprintf(per_character, sizeof(per_character), "%.1f", value / nb_characters);
+        fprintf(out, "%s%-16s  %16lld  %12.3f  %14s\n", indent, events[e].name, value,
+                nb_samples > 0 ? value / nb_samples : 0.0, per_character);
+    }
+    if (m_values[CYCLES] > 0 && m_values[INSTRUCTIONS] >= 0)
+        fprintf(out, "%s%-16s  %16.2f\n", indent, "IPC",
+                (double) m_values[INSTRUCTIONS] / m_values[CYCLES]);
+}
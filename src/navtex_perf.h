@@ -0,0 +1,56 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_PERF_H
+#define _NAVTEX_PERF_H
+
+#include <cstdio>
+
+// Hardware performance counters of the calling process (all its threads,
+// including the ones started after open()), from perf_event_open(2).
+// Counters are often not available (no PMU in a virtual machine, or
+// perf_event_paranoid too strict): they then read as -1, and the rest of
+// the measurements go on without them.
+class perf_counters {
+public:
+    enum event {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,             // level 1 data cache read misses
+        LLC_REFERENCES,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        nb_events
+    };
+
+    perf_counters();
+    ~perf_counters();
+    perf_counters(const perf_counters &) = delete;
+    perf_counters & operator=(const perf_counters &) = delete;
+
+    // Open the counters; returns false if none is available
+    bool open();
+    // Count from zero, and stop counting
+    void start();
+    void stop();
+    // Value at the last stop() (scaled if the counter was multiplexed),
+    // or -1 if the counter is not available
+    long long value(event e) const { return m_values[e]; }
+    static const char * name(event e);
+    // whether any counter was read at the last stop()
+    bool available() const;
+    // Print the counters read at the last stop(), in total, per input
+    // sample and per decoded character, one per line after indent
+    void report(FILE * out, double nb_samples, double nb_characters,
+                const char * indent = "") const;
+
+private:
+    int m_fds[nb_events];
+    long long m_values[nb_events];
+}; // perf_counters
+
+#endif /* _NAVTEX_PERF_H */
@@ -0,0 +1,54 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_placement.h"
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+std::vector<int> placement_cpus() {
+    std::vector<std::pair<int, int>> nodes;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &set))
+                nodes.emplace_back(cpu_node(cpu), cpu);
+    }
+    std::sort(nodes.begin(), nodes.end());
+    std::vector<int> cpus;
+    for (auto & node : nodes)
+        cpus.push_back(node.second);
+    return cpus;
+}
+
+// the node of a CPU is the nodeN entry in its sysfs directory
+int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR * dir = opendir(path);
+    if (dir == nullptr)
+        return 0;
+    int node = 0;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (sscanf(entry->d_name, "node%d", &node) == 1)
+            break;
+        node = 0;
+    }
+    closedir(dir);
+    return node;
+}
+
+bool pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,26 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_PLACEMENT_H
+#define _NAVTEX_PLACEMENT_H
+
+#include <vector>
+
+// CPUs and NUMA nodes, for pinning the decoder threads. Memory is placed
+// by first touch: the pages a thread pinned to a CPU writes first are
+// taken from the node of that CPU, so a decoder built by the thread that
+// runs it has its buffers on the local node, without libnuma.
+
+// The CPUs the process may run on, node by node (and by number within a
+// node, which on most systems puts the SMT siblings last)
+std::vector<int> placement_cpus();
+// NUMA node of cpu (0 on a system without NUMA)
+int cpu_node(int cpu);
+// Pin the calling thread to cpu; returns false if that is not allowed
+bool pin_thread(int cpu);
+
+#endif /* _NAVTEX_PLACEMENT_H */
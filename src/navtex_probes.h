@@ -0,0 +1,45 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_PROBES_H
+#define _NAVTEX_PROBES_H
+
+// USDT (SystemTap SDT) static probes in the decoder, for bpftrace, perf
+// or SystemTap on running decoders, for instance:
+//
+//   bpftrace -e 'usdt:/usr/local/lib/liblibnavtex.so:navtex:fec { @[arg2] = count(); }'
+//
+// A probe is a single nop in the code until a tracer attaches to it, but
+// its arguments are computed at every probe site all the same (there are
+// no semaphores), so they are kept to values the decoder already has at
+// hand and cheap conversions of them. The probes are built in when
+// <sys/sdt.h> is available (systemtap-sdt-dev, systemtap-sdt-devel), and
+// compile to nothing otherwise. The first argument of each probe is the
+// navtex_rx instance, to tell the channels apart:
+//
+//   fft_block(rx, nb_samples)               filter output block
+//   bit(rx, sample, value)                  soft value of a bit
+//   multicorrelator(rx, sample, slope, early, prompt, late)
+//                                           bit timing adjustment, in
+//                                           thousandths of a sample, and
+//                                           the averaged signals
+//   state(rx, sample, old_state, new_state) 0 SYNC_SETUP, 1 SYNC,
+//                                           2 READ_DATA
+//   fec(rx, sample, result)                 1 valid, 0 rep used,
+//                                           -1 FEC calculation, -2 failure
+//   header(rx, sample, origin, subject, number)
+//   message(rx, sample, text, length)       message saved
+//   timeout(rx, sample)                     message flushed by the timeout
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define NAVTEX_PROBE(name, ...) STAP_PROBEV(navtex, name, __VA_ARGS__)
+#else
+#define NAVTEX_PROBE(name, ...) do { } while (0)
+#endif
+
+#endif /* _NAVTEX_PROBES_H */
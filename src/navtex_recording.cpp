@@ -0,0 +1,93 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_recording.h"
+#include "navtex_rx.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+mapped_recording::mapped_recording() :
+    m_data(nullptr),
+    m_nb_samples(0),
+    m_length(0) {
+}
+
+mapped_recording::~mapped_recording() {
+    unmap();
+}
+
+bool mapped_recording::map(int fd) {
+    unmap();
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return false;
+    if (!S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof(short)) {
+        errno = EINVAL;
+        return false;
+    }
+    void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+        return false;
+    m_data = static_cast<const short *>(addr);
+    m_length = st.st_size;
+    m_nb_samples = st.st_size / sizeof(short);
+    return true;
+}
+
+void mapped_recording::unmap() {
+    if (m_data != nullptr)
+        munmap(const_cast<short *>(m_data), m_length);
+    m_data = nullptr;
+    m_nb_samples = 0;
+    m_length = 0;
+}
+
+void seek_decoder(navtex_rx & rx, const short * data, long long start,
+                  long long preroll, int block_size) {
+    long long position = std::max(rx.samples_in(), start - preroll);
+    rx.skip_samples(position - rx.samples_in());
+    rx.set_muted(true);
+    for (; position < start; position += block_size) {
+        int n = std::min((long long) block_size, start - position);
+        rx.process_data(data + position, n);
+    }
+    rx.set_muted(false);
+}
+
+bool parse_position(const char * str, int sample_rate, long long & position) {
+    size_t len = strlen(str);
+    int n;
+    if (len > 0 && str[len - 1] == 's') {
+        double seconds;
+        if (sscanf(str, "%lf%n", &seconds, &n) != 1 || n != (int) len - 1 || seconds < 0)
+            return false;
+        position = seconds * sample_rate;
+        return true;
+    }
+    if (strchr(str, ':') != nullptr) {
+        unsigned hours = 0, minutes;
+        double seconds;
+        if (sscanf(str, "%u:%u:%lf%n", &hours, &minutes, &seconds, &n) != 3 || n != (int) len) {
+            hours = 0;
+            if (sscanf(str, "%u:%lf%n", &minutes, &seconds, &n) != 2 || n != (int) len)
+                return false;
+        }
+        if (minutes >= 60 || seconds < 0 || seconds >= 60)
+            return false;
+        position = ((hours * 60.0 + minutes) * 60.0 + seconds) * sample_rate;
+        return true;
+    }
+    long long samples;
+    if (sscanf(str, "%lld%n", &samples, &n) != 1 || n != (int) len || samples < 0)
+        return false;
+    position = samples;
+    return true;
+}
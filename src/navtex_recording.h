@@ -0,0 +1,49 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_RECORDING_H
+#define _NAVTEX_RECORDING_H
+
+#include <cstddef>
+
+class navtex_rx;
+
+// A raw recording (signed 16 bit samples) mapped in memory, so that the
+// parts that are never decoded are never read from disk
+class mapped_recording {
+public:
+    mapped_recording();
+    ~mapped_recording();
+    mapped_recording(const mapped_recording &) = delete;
+    mapped_recording & operator=(const mapped_recording &) = delete;
+
+    // Map the regular file open on fd; returns false (with errno set)
+    // if it is not a regular file or cannot be mapped
+    bool map(int fd);
+    void unmap();
+
+    const short * data() const { return m_data; }
+    long long nb_samples() const { return m_nb_samples; }
+
+private:
+    const short * m_data;
+    long long m_nb_samples;
+    size_t m_length;
+}; // mapped_recording
+
+// Position the decoder at sample start of data (a decoder cannot go
+// backwards): it is advanced to start - preroll without decoding, and
+// then fed the pre-roll muted, so that its filters and trackers have
+// settled when it starts decoding at start
+void seek_decoder(navtex_rx & rx, const short * data, long long start,
+                  long long preroll, int block_size = 8192);
+
+// Parse a position in a recording: a sample number ("1323000"), seconds
+// with an 's' suffix ("90s", "12.5s"), or a time ("[hh:]mm:ss[.frac]")
+bool parse_position(const char * str, int sample_rate, long long & position);
+
+#endif /* _NAVTEX_RECORDING_H */
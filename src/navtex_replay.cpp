@@ -0,0 +1,156 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_fanout.h"
+#include "navtex_host.h"
+#include "navtex_replay.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <queue>
+#include <random>
+#include <unistd.h>
+
+struct paced_replay::source {
+    int fd;
+    int channel;
+    int sample_rate;
+    int repeat;
+    off_t start;
+    std::unique_ptr<block_pool> pool;
+    std::mt19937 random;
+    sample_block * next;        // read ahead, waiting to be due
+    long long position;         // samples read so far
+    double due;                 // seconds since the start of the replay
+    replay_stats stats;
+};
+
+static double elapsed(const struct timespec & start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+// wait until seconds after start
+static void sleep_until(const struct timespec & start, double seconds) {
+    struct timespec due = start;
+    long long ns = (long long) (seconds * 1e9);
+    due.tv_sec += ns / 1000000000LL;
+    due.tv_nsec += ns % 1000000000LL;
+    if (due.tv_nsec >= 1000000000L) {
+        due.tv_sec++;
+        due.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, nullptr) == EINTR)
+        ;
+}
+
+paced_replay::paced_replay(channel_host & host, FILE * log) :
+    speed(1),
+    block_size(2048),
+    jitter(0),
+    seed(0),
+    m_host(host),
+    m_log(log) {
+}
+
+paced_replay::~paced_replay() {
+    for (auto & s : m_sources)
+        if (s->next != nullptr)
+            s->next->release();
+}
+
+int paced_replay::add_source(int fd, int channel, int repeat) {
+    std::unique_ptr<source> s(new source());
+    s->fd = fd;
+    s->channel = channel;
+    s->sample_rate = m_host.sample_rate(channel);
+    s->repeat = std::max(repeat, 1);
+    s->start = lseek(fd, 0, SEEK_CUR);
+    // enough blocks for a full queue, plus the ones being decoded and
+    // read ahead
+    s->pool.reset(new block_pool(block_size, m_host.queue_len() + 2));
+    // each source draws its own delays, whatever the order of the others
+    s->random.seed(seed + m_sources.size());
+    s->next = nullptr;
+    s->position = 0;
+    s->due = 0;
+    m_sources.push_back(std::move(s));
+    return m_sources.size() - 1;
+}
+
+// Read the next block of s and work out when it is due; false at the end
+bool paced_replay::fill(source & s) {
+    sample_block * block = s.pool->acquire();
+    int size = 0;
+    while (size == 0 && s.repeat > 0) {
+        ssize_t nread = read(s.fd, block->data(), block->capacity() * sizeof(short));
+        if (nread < 0 && errno == EINTR)
+            continue;
+        if (nread < 0) {
+            s.stats.error = errno;
+            break;
+        }
+        size = nread / sizeof(short);
+        // a recording that cannot be rewound is played once
+        if (size == 0 && --s.repeat > 0 && lseek(s.fd, s.start, SEEK_SET) == (off_t) -1)
+            s.repeat = 0;
+    }
+    if (size == 0) {
+        block->release();
+        return false;
+    }
+    block->set_size(size);
+    block->set_position(s.position);
+    s.position += size;
+    double due = (double) s.position / s.sample_rate / speed;
+    if (jitter > 0)
+        due += std::uniform_real_distribution<double>(0, jitter)(s.random);
+    s.due = std::max(s.due, due);
+    s.next = block;
+    return true;
+}
+
+void paced_replay::run() {
+    typedef std::pair<double, int> pending;
+    std::priority_queue<pending, std::vector<pending>, std::greater<pending>> queue;
+    for (size_t i = 0; i < m_sources.size(); i++)
+        if (fill(*m_sources[i]))
+            queue.emplace(m_sources[i]->due, i);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!queue.empty()) {
+        int i = queue.top().second;
+        source & s = *m_sources[i];
+        queue.pop();
+        sleep_until(start, s.due);
+        double late = std::max(elapsed(start) - s.due, 0.0);
+        s.stats.max_late = std::max(s.stats.max_late, late);
+        s.stats.total_late += late;
+        sample_block * block = s.next;
+        s.next = nullptr;
+        int size = block->size();
+        long long position = block->position();
+        s.stats.blocks++;
+        s.stats.samples += size;
+        if (!m_host.push(s.channel, block)) {
+            s.stats.overruns++;
+            if (m_log != nullptr)
+                fprintf(m_log, "[channel %d] overrun at %.1f s: %d samples dropped\n",
+                        s.channel, (double) position / s.sample_rate, size);
+        }
+        if (fill(s))
+            queue.emplace(s.due, i);
+    }
+}
+
+replay_stats paced_replay::stats(int source) const {
+    return m_sources[source]->stats;
+}
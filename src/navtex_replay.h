@@ -0,0 +1,69 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_REPLAY_H
+#define _NAVTEX_REPLAY_H
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+class block_pool;
+class channel_host;
+
+struct replay_stats {
+    long long blocks;           // blocks pushed to the host
+    long long samples;
+    long long overruns;         // blocks the host dropped
+    double max_late;            // seconds a block was pushed after it was due
+    double total_late;
+    int error;                  // errno of a failed read, 0 if none
+};
+
+// Replay of recordings into the real-time channels of a channel_host at
+// the pace of a live input, or speed times faster, for latency and soak
+// tests without a receiver: a block is pushed when its last sample would
+// have come in, plus a random delay of up to jitter seconds (never before
+// the previous block of the same recording). All the recordings are fed
+// by one thread, sleeping with clock_nanosleep() until the next block is
+// due, so that two replays with the same seed push the same blocks, in
+// the same order, with the same delays.
+class paced_replay {
+public:
+    // Every overrun is logged to log, if not nullptr
+    explicit paced_replay(channel_host & host, FILE * log = nullptr);
+    ~paced_replay();
+    paced_replay(const paced_replay &) = delete;
+    paced_replay & operator=(const paced_replay &) = delete;
+
+    // Parameters, to be set before the first add_source()
+    double speed;               // times real time (1)
+    int block_size;             // samples per block (2048)
+    double jitter;              // seconds of random delay, at most (0)
+    unsigned seed;              // of the random delays (0)
+
+    // Feed channel (a real-time channel) with the signed LE16 samples of
+    // fd, from its current position to the end, repeat times over (the
+    // decoder sees the repeats back to back); returns the source number
+    int add_source(int fd, int channel, int repeat = 1);
+    int nb_sources() const { return m_sources.size(); }
+    // Feed all the sources to the end, on the calling thread; the host
+    // must have started
+    void run();
+    replay_stats stats(int source) const;
+
+private:
+    struct source;
+
+    bool fill(source & s);
+
+    channel_host & m_host;
+    FILE * m_log;
+    std::vector<std::unique_ptr<source>> m_sources;
+}; // paced_replay
+
+#endif /* _NAVTEX_REPLAY_H */
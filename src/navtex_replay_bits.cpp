@@ -0,0 +1,122 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// decode a soft bit dump written by navtex_rx_from_file --soft-bits,
+// running only the back end of the decoder; used to try different back
+// end parameters quickly
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include "navtex_rx.h"
+#include "navtex_softbits.h"
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate [file|-]\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -c, --compact            compact mode (bounded messages)\n");
+    fprintf(stderr, "  -t, --sync-threshold=N   lock when the sync score is above N (default: 8)\n");
+    fprintf(stderr, "  -e, --max-errors=N       lose the lock after N errors (default: 5)\n");
+    fprintf(stderr, "  -T, --timeout=S          flush a message without an end after S seconds\n");
+    fprintf(stderr, "                           (default: 600)\n");
+    fprintf(stderr, "  -h, --help               show this help\n");
+}
+
+static int int_arg(const char * name, const char * arg)
+{
+    int value;
+    if (sscanf(arg, "%d", &value) != 1 || value < 0) {
+        fprintf(stderr, "invalid %s: %s\n", name, arg);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+int main(int argc, char** argv)
+{
+    bool compact = false;
+    int sync_threshold = 8;
+    int max_errors = 5;
+    double timeout = 600;
+
+    static const struct option long_options[] = {
+        { "compact",        no_argument,       nullptr, 'c' },
+        { "sync-threshold", required_argument, nullptr, 't' },
+        { "max-errors",     required_argument, nullptr, 'e' },
+        { "timeout",        required_argument, nullptr, 'T' },
+        { "help",           no_argument,       nullptr, 'h' },
+        { nullptr,          0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "ct:e:T:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'c':
+            compact = true;
+            break;
+        case 't':
+            sync_threshold = int_arg("sync threshold", optarg);
+            break;
+        case 'e':
+            max_errors = int_arg("max errors", optarg);
+            break;
+        case 'T':
+            if (sscanf(optarg, "%lf", &timeout) != 1 || timeout <= 0) {
+                fprintf(stderr, "invalid timeout: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int nargs = argc - optind;
+    char ** args = argv + optind;
+    if (nargs < 1 || nargs > 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int sample_rate;
+    if (sscanf(args[0], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", args[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE * in = stdin;
+    if (nargs == 2 && strcmp(args[1], "-") != 0) {
+        in = fopen(args[1], "rb");
+        if (in == nullptr) {
+            fprintf(stderr, "open(%s) failed: %s\n", args[1], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // disable buffering on stdout
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    navtex_rx nv(sample_rate, false, false, stdout, nullptr, stderr, compact);
+    nv.set_sync_threshold(sync_threshold);
+    nv.set_max_errors(max_errors);
+    nv.set_message_timeout(timeout);
+    if (!replay_soft_bits(nv, in, sample_rate)) {
+        fprintf(stderr, "invalid soft bit dump, or wrong sample rate\n");
+        exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+
+    if (in != stdin)
+        fclose(in);
+
+    return 0;
+}
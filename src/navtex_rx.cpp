@@ -183,7 +183,11 @@
 
 #include "fftfilt.h"
 #include "misc.h"
+#include "navtex_bus.h"
+#include "navtex_probes.h"
 #include "navtex_rx.h"
+#include "navtex_softbits.h"
+#include <algorithm>
 #include <climits>
 #include <cstring>
 
@@ -193,27 +197,52 @@ static const double dflt_center_freq = 1000.0 ;
 // Minimum length of logged messages
 static const size_t min_siz_logged_msg = 0;
 
+// Initial capacity of the message buffers; messages longer than this
+// grow the buffers once, and the capacity is then reused
+static const size_t msg_reserve_len = 4096;
+
+// In compact mode messages are flushed when they reach this length
+static const size_t compact_msg_len = 2048;
+
+// Scratch buffers used while displaying a message; they are shared by all
+// the decoders running on a thread, so they cost nothing per channel
+static thread_local ccir_message s_cut_msg;
+static thread_local std::string s_display_buf;
+
+// Called on entry to process_data(), so that the scratch buffers of a
+// thread are allocated with the first samples, not with the first message
+static inline void reserve_scratch() {
+    if (s_display_buf.capacity() < msg_reserve_len) {
+        s_cut_msg.reserve(msg_reserve_len);
+        s_display_buf.reserve(msg_reserve_len);
+    }
+}
+
 // LOG levels and macros
 enum LogLevel {
     DEBUG, INFO, WARN
 };
 
 static const LogLevel log_level = WARN;
-static FILE * s_logfile = nullptr;
 
-#define LOG_DEBUG(...) if (log_level <= DEBUG && s_logfile != nullptr) { fprintf(s_logfile, "[DEBUG] "); fprintf(s_logfile, __VA_ARGS__); fprintf(s_logfile, "\n"); }
-#define LOG_INFO(...) if (log_level <= INFO && s_logfile != nullptr) { fprintf(s_logfile, "[INFO] "); fprintf(s_logfile, __VA_ARGS__); fprintf(s_logfile, "\n"); }
-#define LOG_WARN(...) if (log_level <= WARN && s_logfile != nullptr) { fprintf(s_logfile, "[WARN] "); fprintf(s_logfile, __VA_ARGS__); fprintf(s_logfile, "\n"); }
+// the macros log to the m_logfile of the current navtex_rx instance
+#define LOG_DEBUG(...) if (log_level <= DEBUG && m_logfile != nullptr) { fprintf(m_logfile, "[DEBUG] "); fprintf(m_logfile, __VA_ARGS__); fprintf(m_logfile, "\n"); }
+#define LOG_INFO(...) if (log_level <= INFO && m_logfile != nullptr) { fprintf(m_logfile, "[INFO] "); fprintf(m_logfile, __VA_ARGS__); fprintf(m_logfile, "\n"); }
+#define LOG_WARN(...) if (log_level <= WARN && m_logfile != nullptr) { fprintf(m_logfile, "[WARN] "); fprintf(m_logfile, __VA_ARGS__); fprintf(m_logfile, "\n"); }
 
 
 navtex_rx::navtex_rx(int sample_rate, bool only_sitor_b, bool reverse,
-                     FILE * rawfile, FILE * messagesfile, FILE * logfile) {
+                     FILE * rawfile, FILE * messagesfile, FILE * logfile,
+                     bool compact) {
     m_sample_rate = sample_rate;
     m_only_sitor_b = only_sitor_b;
     m_reverse = reverse;
+    m_compact = compact;
     m_rawfile = rawfile;
     m_messagesfile = messagesfile;
-    s_logfile = logfile;
+    m_logfile = logfile;
+    m_bus = nullptr;
+    m_bus_channel = 0;
 
     m_center_frequency_f = dflt_center_freq;
     // this value must never be zero and bigger than 10.
@@ -226,7 +255,24 @@ navtex_rx::navtex_rx(int sample_rate, bool only_sitor_b, bool reverse,
 
     m_header_found = false;
 
+    m_priority_file = nullptr;
+    m_streaming = false;
+    m_streamed = 0;
+
+    m_max_msg_len = m_compact ? compact_msg_len : 0;
+    m_curr_msg.reserve(m_compact ? compact_msg_len : msg_reserve_len);
+
     m_sample_count = 0;
+    m_samples_in = 0;
+    m_muted = false;
+    m_softbit_writer = nullptr;
+
+    m_sync_threshold = 8;
+    m_max_errors = 5;
+    m_message_timeout = 600;
+
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.first_lock = -1;
 
     m_early_accumulator = 0;
     m_prompt_accumulator = 0;
@@ -242,6 +288,11 @@ navtex_rx::navtex_rx(int sample_rate, bool only_sitor_b, bool reverse,
     m_average_prompt_signal = 0;
     m_average_late_signal = 0;
 
+    m_mark_env = 0;
+    m_space_env = 0;
+    m_mark_noise = 0;
+    m_space_noise = 0;
+
     m_pulse_edge_event = false;
     m_averaged_mark_state = 0;
 
@@ -253,64 +304,161 @@ navtex_rx::navtex_rx(int sample_rate, bool only_sitor_b, bool reverse,
 
     m_alpha_phase = false;
 
-    // keep 1 second worth of bit values for decoding
-    m_bit_values.resize(m_baud_rate);
+    m_last_char = 0;
+
+    memset(m_bit_values, 0, sizeof(m_bit_values));
     m_bit_cursor = 0;
 
     m_mark_lowpass = 0;
     m_space_lowpass = 0;
+    m_compact_lowpass = 0;
+    m_filter_len = 512;
+    m_decimation = 1;
 
     set_filter_values();
     configure_filters();
 }
 
-void navtex_rx::process_data(const float * data, int nb_samples) {
+navtex_rx::~navtex_rx() {
+    delete m_mark_lowpass;
+    delete m_space_lowpass;
+    delete m_compact_lowpass;
+}
 
-    cmplx z, zmark, zspace, *zp_mark, *zp_space;
+void navtex_rx::process_data(const float * data, int nb_samples) {
 
+    reserve_scratch();
     process_timeout();
 
     for (int i = 0; i < nb_samples; i++) {
-        int n_out;
-
         m_time_sec = m_sample_count / m_sample_rate ;
 
-        double dv = 32767 * data[i];
-        z = cmplx(dv, dv);
+        process_sample(32767 * data[i]);
+    }
+    m_samples_in += nb_samples;
+    data_processed(data, nb_samples);
+}
+
+void navtex_rx::process_data(const short * data, int nb_samples) {
 
-        zmark = mixer(m_mark_phase, m_mark_f, z);
-        m_mark_lowpass->run(zmark, &zp_mark);
+    reserve_scratch();
+    process_timeout();
 
-        zspace = mixer(m_space_phase, m_space_f, z);
-        n_out = m_space_lowpass->run(zspace, &zp_space);
+    for (int i = 0; i < nb_samples; i++) {
+        m_time_sec = m_sample_count / m_sample_rate ;
 
-        if (n_out)
-            process_fft_output(zp_mark, zp_space, n_out);
+        process_sample(data[i]);
     }
+    m_samples_in += nb_samples;
+    data_processed(data, nb_samples);
 }
 
-void navtex_rx::process_data(const short * data, int nb_samples) {
+void navtex_rx::skip_samples(long long nb_samples) {
+    // Check the message timeout once a second, as if silence was decoded
+    while (nb_samples > 0) {
+        long long n = std::min(nb_samples, (long long) m_sample_rate);
+        m_sample_count += n;
+        m_next_early_event += n;
+        m_next_prompt_event += n;
+        m_next_late_event += n;
+        m_samples_in += n;
+        m_time_sec = m_sample_count / m_sample_rate ;
+        process_timeout();
+        nb_samples -= n;
+    }
 
-    cmplx z, zmark, zspace, *zp_mark, *zp_space;
+    m_early_accumulator = 0;
+    m_prompt_accumulator = 0;
+    m_late_accumulator = 0;
+    reset_bits();
+    if (m_softbit_writer)
+        m_softbit_writer->put_gap(m_sample_count);
+}
 
+// Forget the bits received before a gap in the input
+void navtex_rx::reset_bits() {
+    memset(m_bit_values, 0, sizeof(m_bit_values));
+    m_bit_cursor = 0;
+    set_state(SYNC_SETUP);
+}
+
+// The soft bits replace the front end: the timeout is checked before
+// each bit rather than before each block of samples.
+void navtex_rx::process_soft_bit(long long sample, int value) {
+    m_sample_count = sample;
+    m_time_sec = m_sample_count / m_sample_rate;
     process_timeout();
+    if (m_state == SYNC_SETUP)
+        setup_sync();
+    handle_bit_value(value);
+}
 
-    for (int i = 0; i < nb_samples; i++) {
-        int n_out;
+void navtex_rx::process_soft_bit_gap(long long sample) {
+    m_sample_count = sample;
+    m_time_sec = m_sample_count / m_sample_rate;
+    process_timeout();
+    reset_bits();
+}
 
-        m_time_sec = m_sample_count / m_sample_rate ;
+void navtex_rx::set_muted(bool muted) {
+    if (muted == m_muted)
+        return;
+    m_muted = muted;
+    if (m_softbit_writer)
+        m_softbit_writer->put_muted(m_sample_count, muted);
+    // the output starts with a new message; text decoded while muted is
+    // never delivered
+    end_priority_stream(false);
+    m_curr_msg.reset_msg();
+    m_header_found = false;
+    m_message_time = m_time_sec;
+}
 
-        z = cmplx(data[i], data[i]);
+size_t navtex_rx::footprint() const {
+    size_t size = sizeof(*this) + m_curr_msg.capacity();
+    if (m_mark_lowpass) size += m_mark_lowpass->footprint();
+    if (m_space_lowpass) size += m_space_lowpass->footprint();
+    if (m_compact_lowpass) size += m_compact_lowpass->footprint();
+    return size;
+}
 
-        zmark = mixer(m_mark_phase, m_mark_f, z);
-        m_mark_lowpass->run(zmark, &zp_mark);
 
-        zspace = mixer(m_space_phase, m_space_f, z);
-        n_out = m_space_lowpass->run(zspace, &zp_space);
+void navtex_rx::set_center_frequency(double frequency) {
+    m_center_frequency_f = frequency;
+    set_filter_values();
+    configure_filters();
+}
 
-        if (n_out)
-            process_fft_output(zp_mark, zp_space, n_out);
+void navtex_rx::set_compact(bool compact) {
+    if (compact == m_compact)
+        return;
+    m_compact = compact;
+    // the filters of the other engine are not needed any more
+    if (m_compact) {
+        delete m_mark_lowpass;
+        delete m_space_lowpass;
+        m_mark_lowpass = 0;
+        m_space_lowpass = 0;
+    } else {
+        delete m_compact_lowpass;
+        m_compact_lowpass = 0;
     }
+    m_max_msg_len = m_compact ? compact_msg_len : 0;
+    set_filter_values();
+    configure_filters();
+}
+
+
+bool navtex_rx::set_decimation(int factor) {
+    // the same test as the filters, on a probe with the same response
+    fftfilt probe(m_baud_rate/m_sample_rate, m_filter_len);
+    probe.rtty_filter(m_baud_rate/m_sample_rate);
+    if (!probe.set_decimation(factor))
+        return false;
+    m_decimation = factor;
+    set_filter_values();
+    configure_filters();
+    return true;
 }
 
 
@@ -323,51 +471,71 @@ void navtex_rx::set_filter_values() {
 }
 
 void navtex_rx::configure_filters() {
-    const int filtlen = 512;
+    const int filtlen = m_filter_len;
+    if (m_compact) {
+        if (m_compact_lowpass) delete m_compact_lowpass;
+        m_compact_lowpass = new fftfilt_fsk(m_baud_rate/m_sample_rate, filtlen,
+                                            m_mark_f, m_space_f, m_sample_rate,
+                                            m_decimation);
+        return;
+    }
+
     if (m_mark_lowpass) delete m_mark_lowpass;
     m_mark_lowpass = new fftfilt(m_baud_rate/m_sample_rate, filtlen);
     m_mark_lowpass->rtty_filter(m_baud_rate/m_sample_rate);
+    m_mark_lowpass->set_decimation(m_decimation);
 
     if (m_space_lowpass) delete m_space_lowpass;
     m_space_lowpass = new fftfilt(m_baud_rate/m_sample_rate, filtlen);
     m_space_lowpass->rtty_filter(m_baud_rate/m_sample_rate);
+    m_space_lowpass->set_decimation(m_decimation);
 }
 
 // Checks that we have no waited too long, and if so, flushes the message with a specific terminator.
 void navtex_rx::process_timeout() {
-    // No messaging in SitorB
-    if (m_only_sitor_b) return;
+    // No messaging in SitorB, and no output while muted
+    if (m_only_sitor_b || m_muted) return;
 
-    bool timeOut = m_time_sec - m_message_time > 600;
+    bool timeOut = m_time_sec - m_message_time > m_message_timeout;
     if (!timeOut) return;
     LOG_INFO("Timeout: time_sec=%lf, message_time=%lf", m_time_sec, m_message_time );
+    NAVTEX_PROBE(timeout, this, m_sample_count);
 
     // TODO: Headerless messages could be dropped if shorter than X chars.
     flush_message(":<TIMEOUT>");
 }
 
 // The parameter is appended at the message end.
-void navtex_rx::flush_message(const std::string & extra_info)
+void navtex_rx::flush_message(const char * extra_info)
 {
+    end_priority_stream(false);
     if (m_header_found)
     {
         m_header_found = false;
-        display_message(m_curr_msg, m_curr_msg + extra_info);
+        display_message(m_curr_msg, "", extra_info);
     }
     else
     {
-        display_message(m_curr_msg, "[Lost header]:" + m_curr_msg + extra_info);
+        display_message(m_curr_msg, "[Lost header]:", extra_info);
     }
     m_curr_msg.reset_msg();
     m_message_time = m_time_sec;
 }
 
-void navtex_rx::display_message(ccir_message & ccir_msg, const std::string & alt_string)
+// The displayed text is assembled in s_display_buf, whose capacity is
+// reused from one message to the next.
+void navtex_rx::display_message(ccir_message & ccir_msg, const char * prefix, const char * suffix)
 {
     if (ccir_msg.size() >= min_siz_logged_msg) {
         try {
-            ccir_msg.display(alt_string);
-            put_received_message(alt_string);
+            s_display_buf.assign(prefix);
+            s_display_buf.append(ccir_msg);
+            s_display_buf.append(suffix);
+            ccir_msg.display(s_display_buf);
+            m_stats.messages++;
+            NAVTEX_PROBE(message, this, m_sample_count, s_display_buf.c_str(),
+                         s_display_buf.size());
+            put_received_message(ccir_msg, s_display_buf);
         } catch (const std::exception & exc) {
             LOG_WARN("Caught %s", exc.what());
         }
@@ -379,11 +547,65 @@ void navtex_rx::display_message(ccir_message & ccir_msg, const std::string & alt
 }
 
 // Called by the engine each time a message is saved.
-void navtex_rx::put_received_message(const std::string & message)
+// ccir_msg holds the cleaned up text and the header of the message.
+void navtex_rx::put_received_message(const ccir_message & ccir_msg, const std::string & message)
 {
     LOG_INFO("%s", message.c_str());
     if (m_messagesfile != nullptr)
         fputs(message.c_str(), m_messagesfile);
+    if (m_bus != nullptr)
+        m_bus->publish(m_bus_channel, ccir_msg.origin(), ccir_msg.subject(),
+                       ccir_msg.number(), m_sample_count, message.data(),
+                       message.size());
+}
+
+void navtex_rx::sync_changed(bool locked)
+{
+    (void) locked;
+}
+
+void navtex_rx::header_detected(const ccir_message & header)
+{
+    (void) header;
+}
+
+void navtex_rx::data_processed(const short * data, int nb_samples)
+{
+    (void) data;
+    (void) nb_samples;
+}
+
+void navtex_rx::data_processed(const float * data, int nb_samples)
+{
+    (void) data;
+    (void) nb_samples;
+}
+
+void navtex_rx::priority_message_begin(const ccir_message & header)
+{
+    if (m_priority_file == nullptr)
+        return;
+    fprintf(m_priority_file, "ZCZC %c%c%02d\n", header.origin(), header.subject(),
+            header.number());
+    fflush(m_priority_file);
+}
+
+void navtex_rx::priority_message_text(const char * text, size_t length)
+{
+    if (m_priority_file == nullptr)
+        return;
+    for (size_t i = 0; i < length; i++)
+        if (text[i] != '\r')
+            putc(text[i], m_priority_file);
+    fflush(m_priority_file);
+}
+
+void navtex_rx::priority_message_end(bool complete)
+{
+    if (m_priority_file == nullptr)
+        return;
+    fputs(complete ? "\nNNNN\n" : "\n[Incomplete]\n", m_priority_file);
+    fflush(m_priority_file);
 }
 
 cmplx navtex_rx::mixer(double & phase, double f, cmplx in)
@@ -396,11 +618,44 @@ cmplx navtex_rx::mixer(double & phase, double f, cmplx in)
     return z;
 }
 
-void navtex_rx::process_fft_output(cmplx * zp_mark, cmplx * zp_space, int samples)
+void navtex_rx::process_sample(double v)
 {
-    // envelope & noise levels for mark & space, respectively
-    static double mark_env = 0, space_env = 0;
-    static double mark_noise = 0, space_noise = 0;
+    cmplx z(v, v);
+    int n_out;
+
+    if (m_compact) {
+        fftfilt_fsk::cmplxf *zp_mark, *zp_space;
+
+        n_out = m_compact_lowpass->run(v, &zp_mark, &zp_space);
+        if (n_out) {
+            NAVTEX_PROBE(fft_block, this, n_out);
+            process_fft_output(zp_mark, zp_space, n_out);
+        }
+        return;
+    }
+
+    cmplx zmark, zspace, *zp_mark, *zp_space;
+
+    zmark = mixer(m_mark_phase, m_mark_f, z);
+    m_mark_lowpass->run(zmark, &zp_mark);
+
+    zspace = mixer(m_space_phase, m_space_f, z);
+    n_out = m_space_lowpass->run(zspace, &zp_space);
+
+    if (n_out) {
+        NAVTEX_PROBE(fft_block, this, n_out);
+        process_fft_output(zp_mark, zp_space, n_out);
+    }
+}
+
+template <typename T>
+void navtex_rx::process_fft_output(const std::complex<T> * zp_mark,
+                                   const std::complex<T> * zp_space, int samples)
+{
+    double & mark_env = m_mark_env, & space_env = m_space_env;
+    double & mark_noise = m_mark_noise, & space_noise = m_space_noise;
+    // each output sample stands for m_decimation input samples
+    const int step = m_decimation;
 
     for (int i = 0; i < samples; i++) {
         double mark_abs = abs(zp_mark[i]);
@@ -440,6 +695,7 @@ void navtex_rx::process_fft_output(cmplx * zp_mark, cmplx * zp_space, int sample
         int mark_state = log(1 + abs(logic_level));
         if (logic_level < 0)
             mark_state = -mark_state;
+        mark_state *= step;
         m_early_accumulator += mark_state;
         m_prompt_accumulator += mark_state;
         m_late_accumulator += mark_state;
@@ -481,17 +737,18 @@ void navtex_rx::process_fft_output(cmplx * zp_mark, cmplx * zp_space, int sample
 
         switch (m_state) {
             case SYNC_SETUP:
-                m_error_count = 0;
-                m_shift = false;
-                set_state(SYNC);
+                setup_sync();
                 break;
             case SYNC:
             case READ_DATA:
-                if (m_pulse_edge_event)
+                if (m_pulse_edge_event) {
+                    if (m_softbit_writer)
+                        m_softbit_writer->put(m_sample_count, m_averaged_mark_state);
                     handle_bit_value(m_averaged_mark_state);
+                }
         }
 
-        m_sample_count++;
+        m_sample_count += step;
     }
 }
 
@@ -512,7 +769,7 @@ void navtex_rx::process_fft_output(cmplx * zp_mark, cmplx * zp_space, int sample
 void navtex_rx::process_multicorrelator()
 {
     // Adjust the sampling period once every 8 bit periods.
-    if (m_sample_count % (int)(m_bit_sample_count * 8))
+    if (m_sample_count % (int)(m_bit_sample_count * 8) >= m_decimation)
         return;
 
     // Calculate the slope between early and late signals
@@ -542,6 +799,9 @@ void navtex_rx::process_multicorrelator()
         m_next_early_event += slope;
         m_next_prompt_event += slope;
         m_next_late_event += slope;
+        NAVTEX_PROBE(multicorrelator, this, m_sample_count, (long long) (slope * 1000),
+                     (long long) m_average_early_signal, (long long) m_average_prompt_signal,
+                     (long long) m_average_late_signal);
         LOG_DEBUG("adjusting by %1.2f, early %1.1f, prompt %1.1f, late %1.1f", slope, m_average_early_signal, m_average_prompt_signal, m_average_late_signal);
     }
 }
@@ -550,9 +810,9 @@ void navtex_rx::process_multicorrelator()
 double navtex_rx::envelope_decay(double avg, double value) {
     int divisor;
     if (value > avg)
-        divisor = m_bit_sample_count / 4;
+        divisor = m_bit_sample_count / 4 / m_decimation;
     else
-        divisor = m_bit_sample_count * 16;
+        divisor = m_bit_sample_count * 16 / m_decimation;
     return decayavg(avg, value, divisor);
 }
 
@@ -560,9 +820,9 @@ double navtex_rx::envelope_decay(double avg, double value) {
 double navtex_rx::noise_decay(double avg, double value) {
     int divisor;
     if (value < avg)
-        divisor = m_bit_sample_count / 4;
+        divisor = m_bit_sample_count / 4 / m_decimation;
     else
-        divisor = m_bit_sample_count * 48;
+        divisor = m_bit_sample_count * 48 / m_decimation;
     return decayavg(avg, value, divisor);
 }
 
@@ -577,22 +837,37 @@ const char * navtex_rx::state_to_str(State s) {
 
 void navtex_rx::set_state(State s) {
     if (s != m_state) {
+        bool was_locked = m_state == READ_DATA;
+        NAVTEX_PROBE(state, this, m_sample_count, (int) m_state, (int) s);
         m_state = s;
         LOG_INFO("State: %s", state_to_str(m_state));
+        if (!was_locked && m_state == READ_DATA) {
+            if (m_stats.locks++ == 0)
+                m_stats.first_lock = m_sample_count;
+        }
+        if (was_locked != (m_state == READ_DATA))
+            sync_changed(!was_locked);
     }
 }
 
+void navtex_rx::setup_sync() {
+    m_error_count = 0;
+    m_shift = false;
+    set_state(SYNC);
+}
+
 // Turns accumulator values (estimates of whether a bit is 1 or 0)
 // into navtex messages
 void navtex_rx::handle_bit_value(int accumulator) {
-    int buffersize = m_bit_values.size();
+    int buffersize = bit_values_len;
     int i, offset = 0;
 
     // Store the received value in the bit stream
     for (i = 0; i < buffersize - 1; i++) {
         m_bit_values[i] = m_bit_values[i+1];
     }
-    m_bit_values[buffersize - 1] = accumulator;
+    m_bit_values[buffersize - 1] = clamp(accumulator, SHRT_MIN + 1, SHRT_MAX);
+    NAVTEX_PROBE(bit, this, m_sample_count, accumulator);
     if (m_bit_cursor > 0)
         m_bit_cursor--;
 
@@ -613,8 +888,14 @@ void navtex_rx::handle_bit_value(int accumulator) {
         if (m_bit_cursor < buffersize - 7) {
             if (m_alpha_phase) {
                 int ret = process_bytes(m_bit_cursor);
+                NAVTEX_PROBE(fec, this, m_sample_count, ret);
+                m_stats.characters++;
+                if (ret == -2)
+                    m_stats.fec_failures++;
+                else if (ret < 1)
+                    m_stats.fec_corrected++;
                 m_error_count -= ret;
-                if (m_error_count > 5)
+                if (m_error_count > m_max_errors)
                     set_state(SYNC_SETUP);
                 if (m_error_count < 0)
                     m_error_count = 0;
@@ -655,7 +936,7 @@ int navtex_rx::find_alpha_characters() {
     for (offset = 35; offset < (35 + 14); offset++) {
         int score = 0;
         int reps = 0;
-        int limit = m_bit_values.size() - 7;
+        int limit = bit_values_len - 7;
 
         // Search for the largest sequence of valid characters
         for (i = offset; i < limit; i += 7) {
@@ -696,15 +977,15 @@ int navtex_rx::find_alpha_characters() {
         }
     }
 
-    // m_bit_values fits 14 characters; if there are at least
-    // 9 good ones, tell the caller where they start
-    if (best_score > 8)
+    // m_bit_values fits 14 characters; if there are enough good
+    // ones (at least 9 by default), tell the caller where they start
+    if (best_score > m_sync_threshold)
         return best_offset;
     else
         return -1;
 }
 
-static void flip_smallest_bit(int * pos);
+static void flip_smallest_bit(short * pos);
 
 // Turn a series of 7 bit confidence values into a character
 //
@@ -729,7 +1010,8 @@ int navtex_rx::process_bytes(int m_bit_cursor) {
     // Try the rep (duplicate) copy of the character, and some
     // permutations to see if the correct character can be found.
     {
-        int i, calc, avg[7];
+        int i, calc;
+        short avg[7];
         // Rep is 5 characters before alpha.
         int reppos = fec_offset(m_bit_cursor);
         int rep = m_ccir476.bytes_to_code(&m_bit_values[reppos]);
@@ -748,7 +1030,7 @@ int navtex_rx::process_bytes(int m_bit_cursor) {
         for (i = 0; i < 7; i++) {
             int a = m_bit_values[m_bit_cursor + i];
             int r = m_bit_values[reppos + i];
-            avg[i] = a + r;
+            avg[i] = clamp(a + r, SHRT_MIN + 1, SHRT_MAX);
         }
 
         calc = m_ccir476.bytes_to_code(avg);
@@ -800,7 +1082,7 @@ decode:
 }
 
 bool navtex_rx::process_char(int chr) {
-    static int last_char = 0;
+    int & last_char = m_last_char;
     switch (chr) {
         case code_rep:
             // This code should run in alpha phase, but
@@ -827,7 +1109,7 @@ bool navtex_rx::process_char(int chr) {
             chr = m_ccir476.code_to_char(chr, m_shift);
             if (chr < 0) {
                 LOG_INFO("Missed this code: %x", abs(chr));
-            } else {
+            } else if (!m_muted) {
                 filter_print(chr);
                 process_messages(chr);
             }
@@ -854,6 +1136,10 @@ void navtex_rx::put_rx_char(int c) {
 }
 
 void navtex_rx::process_messages(int c) {
+    // Bounded message buffer: deliver what was received so far
+    if (m_max_msg_len && m_curr_msg.size() >= m_max_msg_len)
+        flush_message(":<TRUNCATED>");
+
     m_curr_msg.push_back((char) c);
 
     /// No header nor trailer for plain SitorB.
@@ -863,31 +1149,71 @@ void navtex_rx::process_messages(int c) {
         return;
     }
 
-    ccir_message::detect_result msg_cut = m_curr_msg.detect_header();
-    if (msg_cut.first) {
+    if (m_curr_msg.detect_header(s_cut_msg)) {
+        end_priority_stream(false);
         /// Maybe the message was already valid.
         if (m_header_found)
         {
-            display_message( msg_cut.second, msg_cut.second + ":[Lost trailer]" );
+            display_message( s_cut_msg, "", ":[Lost trailer]" );
         }
         else
         {
             /// Maybe only non-significant chars.
-            if (!msg_cut.second.empty())
+            if (!s_cut_msg.empty())
             {
-                display_message( msg_cut.second, "[Lost header]:" + msg_cut.second + ":[Lost trailer]" );
+                display_message( s_cut_msg, "[Lost header]:", ":[Lost trailer]" );
             }
         }
         m_header_found = true;
         m_message_time = m_time_sec;
+        m_stats.headers++;
+        NAVTEX_PROBE(header, this, m_sample_count, m_curr_msg.origin(),
+                     m_curr_msg.subject(), m_curr_msg.number());
+        header_detected(m_curr_msg);
+        if (m_priority_subjects.find(m_curr_msg.subject()) != std::string::npos) {
+            m_streaming = true;
+            m_streamed = 0;
+            priority_message_begin(m_curr_msg);
+        }
 
     } else { // valid message state
         if (m_curr_msg.detect_end()) {
+            LOG_INFO("\n%s", m_curr_msg.c_str());
+            end_priority_stream(true);
+            if (m_header_found)
+                m_stats.complete_messages++;
             flush_message("");
+        } else if (m_streaming) {
+            stream_priority_text(false);
         }
     }
 }
 
+// Pass the text received since the last call to the priority stream,
+// except for what may be the start of a header or of the trailer
+// (unless all)
+void navtex_rx::stream_priority_text(bool all) {
+    size_t end = m_curr_msg.size();
+    if (!all)
+        end -= m_curr_msg.pending_marker_len();
+    if (end > m_streamed) {
+        priority_message_text(m_curr_msg.data() + m_streamed, end - m_streamed);
+        m_streamed = end;
+    }
+}
+
+void navtex_rx::finish() {
+    end_priority_stream(false);
+}
+
+void navtex_rx::end_priority_stream(bool complete) {
+    if (!m_streaming)
+        return;
+    stream_priority_text(true);
+    m_streaming = false;
+    priority_message_end(complete);
+}
+
 // The rep character is transmitted 5 characters (35 bits) ahead of
 // the alpha character.
 static int fec_offset(int offset) {
@@ -896,7 +1222,7 @@ static int fec_offset(int offset) {
 
 // Flip the sign of the smallest (least certain) bit in a character;
 // hopefully this will result in the right valid character.
-static void flip_smallest_bit(int * pos) {
+static void flip_smallest_bit(short * pos) {
     int min_zero = INT_MIN, min_one = INT_MAX;
     int min_zero_pos = -1, min_one_pos = -1;
     int count_zero = 0, count_one = 1;
@@ -947,7 +1273,9 @@ void ccir_message::reset_msg() {
     init_members();
 }
 
-ccir_message::detect_result ccir_message::detect_header() {
+// On success the garbage before the header is copied to msg_cut,
+// reusing its storage.
+bool ccir_message::detect_header(ccir_message & msg_cut) {
     size_t qlen = size();
 
     if (qlen >= header_len) {
@@ -967,18 +1295,21 @@ ccir_message::detect_result ccir_message::detect_header() {
 
             // This returns the garbage before the valid header.
             // Garbage because the trailer could not be read, but maybe header OK.
-            ccir_message msg_cut(substr(0, size() - header_len),
-                                 m_origin, m_subject, m_number);
+            msg_cut.assign(*this, 0, qlen - header_len);
+            msg_cut.m_origin = m_origin;
+            msg_cut.m_subject = m_subject;
+            msg_cut.m_number = m_number;
+            msg_cut.cleanup();
             m_origin  = comp[5];
             m_subject = comp[6];
             m_number = (comp[7] - '0') * 10 + (comp[8] - '0');
             // Remove the beginning useless chars.
             /// TODO: Read broken headers such as "ZCZC EA0?"
             clear();
-            return detect_result(true, msg_cut);
+            return true;
         }
     }
-    return detect_result(false, ccir_message());
+    return false;
 }
 
 bool ccir_message::detect_end() {
@@ -989,15 +1320,39 @@ bool ccir_message::detect_end() {
     if (qlen < slen) {
         return false;
     }
-    std::string comp = substr(qlen - slen, slen);
-    bool end_seen = comp == stop_valid;
+    bool end_seen = compare(qlen - slen, slen, stop_valid) == 0;
     if(end_seen) {
         erase(qlen - slen, slen);
-        LOG_INFO("\n%s", c_str());
     }
     return end_seen;
 }
 
+size_t ccir_message::pending_marker_len() const {
+    static const size_t end_len = 3;
+    size_t qlen = size();
+    for (size_t len = std::min(qlen, header_len - 1); len > 0; len--) {
+        const char * tail = data() + qlen - len;
+        // a prefix of "ZCZC xx99"
+        bool header = true;
+        for (size_t i = 0; i < len && header; i++) {
+            char c = tail[i];
+            if (i < 4)
+                header = c == "ZCZC"[i];
+            else if (i == 4)
+                header = c == ' ';
+            else if (i < 7)
+                header = isalnum(c);
+            else
+                header = isdigit(c);
+        }
+        if (header)
+            return len;
+        if (len <= end_len && tail[0] == 'N' && std::count(tail, tail + len, 'N') == (std::ptrdiff_t) len)
+            return len;
+    }
+    return 0;
+}
+
 void ccir_message::display(const std::string & alt_string) {
     std::string::operator=(alt_string);
     cleanup();
@@ -1008,15 +1363,14 @@ void ccir_message::display(const std::string & alt_string) {
 
 // Remove non-Ascii chars, replace new-line by special character etc....
 void ccir_message::cleanup() {
-    // This is temporary, to manipulate a multi-line string.
-    static const char * new_line = "\n";
-
-    // It would be possible to do the change in place, because the new string
-    // it shorter than the current one, but at the expense of clarity.
+    // The change is done in place, because the new string is never longer
+    // than the current one: every delimiter written is preceded by at least
+    // one delimiter read. This avoids allocating a temporary string.
     bool wasDelim = false, wasSpace = false, chrSeen = false;
-    std::string newStr ;
-    for (iterator it = begin(); it != end(); ++it) {
-        switch(*it) {
+    size_t out = 0;
+    for (size_t in = 0; in < size(); in++) {
+        char c = (*this)[in];
+        switch(c) {
             case '\n':
             case '\r': wasDelim = true ;
                        break ;
@@ -1025,18 +1379,18 @@ void ccir_message::cleanup() {
                        break ;
             default: if (chrSeen) {
                          if (wasDelim) {
-                             newStr.append(new_line);
+                             (*this)[out++] = '\n';
                          } else if(wasSpace) {
-                             newStr.push_back(' ');
+                             (*this)[out++] = ' ';
                          }
                      }
                      wasDelim = false;
                      wasSpace = false;
                      chrSeen = true;
-                     newStr.push_back(*it);
+                     (*this)[out++] = c;
         }
     }
-    swap(newStr);
+    resize(out);
 }
 
 void ccir_message::init_members() {
@@ -1071,45 +1425,56 @@ static const unsigned char code_to_figs[128] = {
     '_', '9', '?', '_', '5', '_', '_', '_', '\r', '_', '_', '_', '_', '_', '_', '_' // 7
 };
 
+unsigned char CCIR476::s_ltrs_to_code[128];
+unsigned char CCIR476::s_figs_to_code[128];
+bool CCIR476::s_valid_codes[128];
+
 CCIR476::CCIR476() {
-    memset(m_ltrs_to_code, 0, 128);
-    memset(m_figs_to_code, 0, 128);
-    for (size_t i = 0; i < 128; i++) m_valid_codes[i] = false ;
+    // built once, by the first instance
+    static const bool tables_built = build_tables();
+    (void) tables_built;
+}
+
+bool CCIR476::build_tables() {
+    memset(s_ltrs_to_code, 0, 128);
+    memset(s_figs_to_code, 0, 128);
+    for (size_t i = 0; i < 128; i++) s_valid_codes[i] = false ;
     for (int code = 0; code < 128; code++) {
         // Valid codes have four bits set only. This leaves three bits for error detection.
         // TODO: If a code is invalid, we could take the closest value in terms of bits.
         if (check_bits(code)) {
-            m_valid_codes[code] = true;
+            s_valid_codes[code] = true;
             unsigned char figv = code_to_figs[code];
             unsigned char ltrv = code_to_ltrs[code];
             if (figv != '_') {
-                m_figs_to_code[figv] = code;
+                s_figs_to_code[figv] = code;
             }
             if (ltrv != '_') {
-                m_ltrs_to_code[ltrv] = code;
+                s_ltrs_to_code[ltrv] = code;
             }
         }
     }
+    return true;
 }
 
 void CCIR476::char_to_code(std::string & str, int ch, bool & ex_shift) const {
     ch = toupper(ch);
     // avoid unnecessary shifts
-    if (ex_shift && m_figs_to_code[ch] != '\0') {
-        str.push_back(m_figs_to_code[ch]);
+    if (ex_shift && s_figs_to_code[ch] != '\0') {
+        str.push_back(s_figs_to_code[ch]);
     }
-    else if (!ex_shift && m_ltrs_to_code[ch] != '\0') {
-        str.push_back(m_ltrs_to_code[ch]);
+    else if (!ex_shift && s_ltrs_to_code[ch] != '\0') {
+        str.push_back(s_ltrs_to_code[ch]);
     }
-    else if (m_figs_to_code[ch] != '\0') {
+    else if (s_figs_to_code[ch] != '\0') {
         ex_shift = true;
         str.push_back(code_figs);
-        str.push_back(m_figs_to_code[ch]);
+        str.push_back(s_figs_to_code[ch]);
     }
-    else if (m_ltrs_to_code[ch] != '\0') {
+    else if (s_ltrs_to_code[ch] != '\0') {
         ex_shift = false;
         str.push_back(code_ltrs);
-        str.push_back(m_ltrs_to_code[ch]);
+        str.push_back(s_ltrs_to_code[ch]);
     }
 }
 
@@ -1122,7 +1487,7 @@ int CCIR476::code_to_char(int code, bool shift) const {
     return -code;
 }
 
-int CCIR476::bytes_to_code(int * pos) {
+int CCIR476::bytes_to_code(const short * pos) const {
     int code = 0;
     int i;
 
@@ -1131,7 +1496,7 @@ int CCIR476::bytes_to_code(int * pos) {
     return code;
 }
 
-int CCIR476::bytes_to_char(int * pos, int shift) {
+int CCIR476::bytes_to_char(const short * pos, int shift) const {
     int code = bytes_to_code(pos);
     return code_to_char(code, shift);
 }
@@ -1149,7 +1514,7 @@ bool CCIR476::check_bits(int v) {
 }
 
 // Is there a valid character in the next 7 ints?
-bool CCIR476::valid_char_at(int * pos) {
+bool CCIR476::valid_char_at(const short * pos) const {
     int count = 0;
     int i;
 
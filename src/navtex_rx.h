@@ -11,18 +11,24 @@
 #include <complex>
 #include <cstdio>
 #include <string>
-#include <vector>
 
 class ccir_message : public std::string {
 public:
-    typedef std::pair<bool, ccir_message> detect_result;
     ccir_message();
     ccir_message(const std::string & s, char origin, char subject, int number);
     void reset_msg();
-    detect_result detect_header();
+    bool detect_header(ccir_message & msg_cut);
     bool detect_end();
+    // number of characters at the end that may be the start of a ZCZC
+    // header or of the NNNN trailer
+    size_t pending_marker_len() const;
     void display(const std::string & alt_string);
 
+    // B1, B2 and B3B4 of the header ('?', '?' and 0 when there is none)
+    char origin() const { return m_origin; }
+    char subject() const { return m_subject; }
+    int number() const { return m_number; }
+
 private:
     static const size_t header_len = 10;
     static const size_t trunc_len = 5;
@@ -47,58 +53,164 @@ public:
     CCIR476();
     void char_to_code(std::string & str, int ch, bool & ex_shift) const;
     int code_to_char(int code, bool shift) const;
-    int bytes_to_code(int * pos);
-    int bytes_to_char(int * pos, int shift);
+    int bytes_to_code(const short * pos) const;
+    int bytes_to_char(const short * pos, int shift) const;
     static bool check_bits(int v);
-    bool valid_char_at(int * pos);
+    bool valid_char_at(const short * pos) const;
 
 private:
-    unsigned char m_ltrs_to_code[128];
-    unsigned char m_figs_to_code[128];
-    bool m_valid_codes[128];
+    // lookup tables are shared by all the instances
+    static unsigned char s_ltrs_to_code[128];
+    static unsigned char s_figs_to_code[128];
+    static bool s_valid_codes[128];
+    static bool build_tables();
 }; // CCIR476
 
 
 class fftfilt;
+class fftfilt_fsk;
+class softbit_writer;
+class message_bus_writer;
 typedef std::complex<double> cmplx;
 
+// Decoding statistics, for comparing decoder configurations
+struct navtex_stats {
+    long long characters;       // alpha characters processed
+    long long fec_corrected;    // of which recovered with the rep or by FEC
+    long long fec_failures;     // of which not recovered
+    long long locks;            // times the decoder locked on a signal
+    long long first_lock;       // sample of the first lock (-1 if none)
+    long long headers;          // ZCZC headers received
+    long long messages;         // messages saved, fragments included
+    long long complete_messages; // of which with their header and NNNN
+};
+
 class navtex_rx {
 public:
+    // compact: trade some precision for a much smaller state per channel
+    // (single precision filters with shared tables, bounded messages)
     navtex_rx(int sample_rate, bool only_sitor_b, bool reverse,
               FILE * rawfile=stdout, FILE * messagesfile=nullptr,
-              FILE * logfile=stderr);
+              FILE * logfile=stderr, bool compact=false);
+    virtual ~navtex_rx();
+    navtex_rx(const navtex_rx &) = delete;
+    navtex_rx & operator=(const navtex_rx &) = delete;
     void process_data(const float * data, int nb_samples);
     void process_data(const short * data, int nb_samples);
+    // Advance the decoder by nb_samples samples without processing them,
+    // as if they were silence; the decoder needs a few seconds of signal
+    // afterwards to settle again.
+    void skip_samples(long long nb_samples);
+    // While muted the decoder runs normally, but it does not output any
+    // character or message; used to warm it up over a pre-roll.
+    void set_muted(bool muted);
+    // bytes of memory used by this channel (tables shared between
+    // channels are not included)
+    size_t footprint() const;
+    // number of samples processed by the decoder so far
+    long long sample_count() const { return m_sample_count; }
+    // number of input samples passed in or skipped so far
+    long long samples_in() const { return m_samples_in; }
+    // Publish the messages saved on bus (see navtex_bus.h), as coming
+    // from channel; nullptr to stop
+    void set_message_bus(message_bus_writer * bus, unsigned channel = 0) {
+        m_bus = bus;
+        m_bus_channel = channel;
+    }
+    // Tune the decoder to another center frequency (1000Hz by default);
+    // the filters are reset
+    void set_center_frequency(double frequency);
+    // Switch between the normal and the compact engine while decoding;
+    // the filters are reset
+    void set_compact(bool compact);
+    bool compact() const { return m_compact; }
+    // Decimate the output of the filters by factor (a power of two), so
+    // that the demodulator runs at a fraction of the sample rate: the
+    // filters keep only their passband and run a smaller inverse FFT (see
+    // fftfilt::set_decimation()). False, and no change, if the passband
+    // does not fit; the filters are reset
+    bool set_decimation(int factor);
+    int decimation() const { return m_decimation; }
+    // the decoder is locked on a signal
+    bool locked() const { return m_state == READ_DATA; }
+    const navtex_stats & stats() const { return m_stats; }
+    // Back end parameters: the score (valid characters plus FEC reps)
+    // above which the decoder locks on a signal (8), the number of
+    // decoding errors that lose the lock (5), and the seconds after which
+    // a message without an end is flushed (600)
+    void set_sync_threshold(int threshold) { m_sync_threshold = threshold; }
+    void set_max_errors(int max_errors) { m_max_errors = max_errors; }
+    void set_message_timeout(double timeout) { m_message_timeout = timeout; }
+    // Write the soft bit values that the front end passes to the back end
+    // to writer, or stop writing them if nullptr (see navtex_softbits.h)
+    void set_soft_bit_writer(softbit_writer * writer) { m_softbit_writer = writer; }
+    // Stream the messages whose subject (B2) is in subjects (for instance
+    // "ABDL") as they are received, from the header on, instead of only
+    // when they are complete; by default the stream is written to sink
+    // (see the priority_message_* hooks). The messages are still saved
+    // as usual at the end.
+    void set_priority_subjects(const std::string & subjects, FILE * sink=nullptr) {
+        m_priority_subjects = subjects;
+        m_priority_file = sink;
+    }
+    // End of the input: a priority message still being streamed is ended
+    // as incomplete (priority_message_end(false)); call it before closing
+    // the sink. Derived decoders that keep something open until the end
+    // of the input (clip_recorder) override it and call this one.
+    virtual void finish();
+    // Back end only decoding, from a soft bit dump: the value of the bit
+    // taken at sample, and a gap in the input (skip_samples()) that ends
+    // at sample
+    void process_soft_bit(long long sample, int value);
+    void process_soft_bit_gap(long long sample);
+    // position in the input of the sample the decoder is working on;
+    // the filters delay the signal, so it lags the samples passed in
+    long long input_position() const {
+        return m_sample_count + m_filter_len / 4;
+    }
+    // the decoder holds received text that has not been delivered yet
+    // (by put_received_message(), or discarded as too short)
+    bool message_pending() const { return !m_curr_msg.empty(); }
+
+protected:
+    // Called by the engine for each character received, and for each
+    // message saved; they write to rawfile and messagesfile by default,
+    // subclasses can override them to receive the text directly.
+    virtual void put_rx_char(int c);
+    virtual void put_received_message(const ccir_message & ccir_msg,
+                                      const std::string & message);
+    // Called when the decoder locks on a signal and when it loses it,
+    // and when a ZCZC header is recognised; they do nothing by default.
+    virtual void sync_changed(bool locked);
+    virtual void header_detected(const ccir_message & header);
+    // Called at the end of process_data() with the samples just processed
+    // (samples_in() is then the position after them); does nothing by
+    // default.
+    virtual void data_processed(const short * data, int nb_samples);
+    virtual void data_processed(const float * data, int nb_samples);
+    // Called for the priority messages (see set_priority_subjects()):
+    // when the header is recognised, with each new piece of text as
+    // received (raw, with \r\n line ends; the characters that may be
+    // the start of NNNN or of another header are held back until they
+    // turn out not to be),
+    // and at the end; complete is false when the message is cut short
+    // (timeout, new header, truncation). They write to the priority sink
+    // by default.
+    virtual void priority_message_begin(const ccir_message & header);
+    virtual void priority_message_text(const char * text, size_t length);
+    virtual void priority_message_end(bool complete);
 
 private:
-    int m_sample_rate;
-    bool m_only_sitor_b;
-    bool m_reverse;
-    FILE * m_rawfile;
-    FILE * m_messagesfile;
-
-    // filter method related
-    double m_center_frequency_f;
-
-    double m_baud_rate;
-
+    // hot state, updated for every sample: keep it together at the start
+    // of the object, so that it spans as few cache lines as possible
+    alignas(64) double m_mark_phase;
+    double m_space_phase;
     double m_mark_f;
     double m_space_f;
-    double m_mark_phase;
-    double m_space_phase;
-
-    fftfilt *m_mark_lowpass;
-    fftfilt *m_space_lowpass;
-
-    double m_time_sec;
-    double m_message_time;
 
-    bool m_header_found;
-
-    ccir_message m_curr_msg;
-
-    int m_sample_count;
     double m_bit_sample_count;
+    long long m_sample_count;
+    int m_averaged_mark_state;
 
     double m_early_accumulator;
     double m_prompt_accumulator;
@@ -111,20 +223,76 @@ private:
     double m_average_prompt_signal;
     double m_average_late_signal;
 
-    bool m_pulse_edge_event;
+    // envelope & noise levels for mark & space, respectively
+    double m_mark_env;
+    double m_space_env;
+    double m_mark_noise;
+    double m_space_noise;
 
-    int m_averaged_mark_state;
+    bool m_pulse_edge_event;
+    bool m_reverse;
+    bool m_compact;
 
     enum State { SYNC_SETUP, SYNC, READ_DATA };
     State m_state;
 
+    fftfilt *m_mark_lowpass;
+    fftfilt *m_space_lowpass;
+    fftfilt_fsk *m_compact_lowpass;
+    int m_filter_len;
+    int m_decimation;
+
+    // cold state
+    int m_sample_rate;
+    bool m_only_sitor_b;
+    FILE * m_rawfile;
+    FILE * m_messagesfile;
+    FILE * m_logfile;
+    message_bus_writer * m_bus;
+    unsigned m_bus_channel;
+
+    long long m_samples_in;
+    bool m_muted;
+    softbit_writer * m_softbit_writer;
+
+    // back end parameters
+    int m_sync_threshold;
+    int m_max_errors;
+    double m_message_timeout;
+
+    navtex_stats m_stats;
+
+    // filter method related
+    double m_center_frequency_f;
+
+    double m_baud_rate;
+
+    double m_time_sec;
+    double m_message_time;
+
+    bool m_header_found;
+
+    std::string m_priority_subjects;
+    FILE * m_priority_file;
+    bool m_streaming;
+    // characters of m_curr_msg passed to priority_message_text()
+    size_t m_streamed;
+
+    ccir_message m_curr_msg;
+    // 0 means unbounded
+    size_t m_max_msg_len;
+
     int m_error_count;
 
     bool m_shift;
 
     bool m_alpha_phase;
 
-    std::vector<int> m_bit_values;
+    int m_last_char;
+
+    // keep 1 second worth of bit values for decoding
+    static const int bit_values_len = 100;
+    short m_bit_values[bit_values_len];
     int m_bit_cursor;
 
     CCIR476 m_ccir476;
@@ -134,23 +302,28 @@ private:
     void set_filter_values();
     void configure_filters();
     void process_timeout();
-    void flush_message(const std::string & extra_info);
-    void display_message(ccir_message & ccir_msg, const std::string & alt_string );
-    void put_received_message(const std::string & message);
+    void flush_message(const char * extra_info);
+    void display_message(ccir_message & ccir_msg, const char * prefix, const char * suffix);
     cmplx mixer(double & phase, double f, cmplx in);
-    void process_fft_output(cmplx * zp_mark, cmplx * zp_space, int samples);
+    void process_sample(double v);
+    template <typename T>
+    void process_fft_output(const std::complex<T> * zp_mark,
+                            const std::complex<T> * zp_space, int samples);
     void process_multicorrelator();
     double envelope_decay(double avg, double value);
     double noise_decay(double avg, double value);
     static const char * state_to_str(State s);
     void set_state(State s);
+    void setup_sync();
+    void reset_bits();
     void handle_bit_value(int accumulator);
     int find_alpha_characters();
     int process_bytes(int m_bit_cursor);
     bool process_char(int chr);
     void filter_print(int c);
-    void put_rx_char(int c);
     void process_messages(int c);
+    void stream_priority_text(bool all);
+    void end_priority_stream(bool complete);
 }; // navtex_rx
 
 #endif /* _NAVTEX_RX_H */
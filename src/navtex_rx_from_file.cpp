@@ -8,62 +8,701 @@
 // decode a NAVTEX sound file (signed LE16 sampled at 11025Hz)
 // NOTE: a different sample rate (for instance 48kHz) works too
 //       (see examples in the README file)
+// A multichannel file (several receivers recorded together, raw or WAV)
+// is read once and split into its channels, which are decoded in
+// parallel, each by its own decoder; their messages are printed with the
+// channel number.
 
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
+#include <getopt.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
+#include "navtex_activity.h"
+#include "navtex_bus.h"
+#include "navtex_clip.h"
+#include "navtex_fanout.h"
+#include "navtex_host.h"
+#include "navtex_index.h"
+#include "navtex_multichannel.h"
+#include "navtex_recording.h"
 #include "navtex_rx.h"
+#include "navtex_shm.h"
+#include "navtex_softbits.h"
 
 constexpr int BUFSIZE = 8192;
+constexpr double default_preroll = 5.0;
+constexpr double default_pre_trigger = 5.0;
+// how often to look for new samples in the capture ring (us)
+constexpr int shm_poll_interval = 10000;
+// size of the message bus
+constexpr int bus_records = 1024;
+constexpr int bus_arena_size = 1 << 20;
+// blocks each channel of a multichannel file can have waiting
+constexpr int channel_queue_len = 4;
 
-int main(int argc, const char** argv)
+// Settings of a channel of a multichannel file (-k)
+struct channel_settings {
+    bool enabled = true;
+    int compact = -1;           // -1: as --compact
+    double frequency = 0;       // center frequency (0: the default)
+    bool reverse = false;
+    bool only_sitor_b = false;
+};
+
+static std::mutex output_mutex;
+
+// navtex_rx that prints its messages with its channel number
+class channel_rx : public navtex_rx {
+public:
+    channel_rx(int channel, int sample_rate, const channel_settings & settings,
+               bool compact) :
+        navtex_rx(sample_rate, settings.only_sitor_b, settings.reverse, nullptr,
+                  nullptr, stderr,
+                  settings.compact == -1 ? compact : settings.compact == 1),
+        m_channel(channel) {
+        if (settings.frequency > 0)
+            set_center_frequency(settings.frequency);
+    }
+
+protected:
+    void put_received_message(const ccir_message & ccir_msg,
+                              const std::string & message) override {
+        // the message bus is shared by the channels
+        std::lock_guard<std::mutex> lock(output_mutex);
+        printf("[%d] %s\n", m_channel, message.c_str());
+        navtex_rx::put_received_message(ccir_msg, message);
+    }
+
+private:
+    int m_channel;
+};
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] [sample_rate [file|-]]\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -c, --compact    compact mode (small memory footprint per channel)\n");
+    fprintf(stderr, "  -d, --decimate=N run the demodulator at 1/N of the sample rate (N: a\n");
+    fprintf(stderr, "                   power of two; less work, with some loss of\n");
+    fprintf(stderr, "                   sensitivity as N grows)\n");
+    fprintf(stderr, "  -f, --fast-scan  decode only the regions with signal activity\n");
+    fprintf(stderr, "                   (the input must be a regular file)\n");
+    fprintf(stderr, "  -i, --index=IDX  decode only the activity regions listed in the index\n");
+    fprintf(stderr, "                   IDX (see navtex_build_index)\n");
+    fprintf(stderr, "  -s, --start=POS  start decoding at POS (the input must be a regular file);\n");
+    fprintf(stderr, "                   header:B1B2B3B4 for where the index has that message\n");
+    fprintf(stderr, "  -e, --end=POS    stop decoding at POS\n");
+    fprintf(stderr, "  -p, --preroll=S  seconds of signal before the start position used to\n");
+    fprintf(stderr, "                   settle the decoder (default: %g)\n", default_preroll);
+    fprintf(stderr, "  -C, --clips=DIR  save the audio of each message in a clip file in DIR\n");
+    fprintf(stderr, "  -P, --pre-trigger=S  seconds of audio before the trigger in the clips\n");
+    fprintf(stderr, "                   (default: %g)\n", default_pre_trigger);
+    fprintf(stderr, "  -S, --sync-trigger  start the clips when the decoder locks on a signal,\n");
+    fprintf(stderr, "                   instead of when a header is received\n");
+    fprintf(stderr, "  -b, --soft-bits=FILE  write the soft bit values to FILE, for\n");
+    fprintf(stderr, "                   navtex_replay_bits\n");
+    fprintf(stderr, "  -m, --shm=NAME   decode the samples in the shared memory capture ring\n");
+    fprintf(stderr, "                   NAME (see navtex_shm_writer), instead of a file\n");
+    fprintf(stderr, "  -B, --bus=NAME   publish the messages on the shared memory message bus\n");
+    fprintf(stderr, "                   NAME (see navtex_bus_reader)\n");
+    fprintf(stderr, "  -u, --urgent=SUBJECTS  stream the messages with these subjects (B2,\n");
+    fprintf(stderr, "                   for instance ABDL) as they are received\n");
+    fprintf(stderr, "  -U, --urgent-file=FILE  where to stream them (default: standard error)\n");
+    fprintf(stderr, "  -w, --wav        the input is a WAV file (16 bit PCM; the sample rate\n");
+    fprintf(stderr, "                   and the number of channels are taken from it, and a\n");
+    fprintf(stderr, "                   sample_rate of 0 stands for the one of the file)\n");
+    fprintf(stderr, "  -n, --channels=N the input has N interleaved channels, decoded in\n");
+    fprintf(stderr, "                   parallel\n");
+    fprintf(stderr, "  -k, --channel=CH:SETTINGS  settings of channel CH (from 0) of a\n");
+    fprintf(stderr, "                   multichannel input, separated by commas: freq=HZ\n");
+    fprintf(stderr, "                   (center frequency), reverse, sitor-b, compact,\n");
+    fprintf(stderr, "                   normal (not compact), off (not decoded)\n");
+    fprintf(stderr, "  -j, --threads=N  threads decoding the channels of a multichannel\n");
+    fprintf(stderr, "                   input (default: number of CPUs)\n");
+    fprintf(stderr, "  -h, --help       show this help\n");
+    fprintf(stderr, "POS is a sample number, a number of seconds followed by 's' (90s),\n");
+    fprintf(stderr, "or a time as [hh:]mm:ss[.frac]\n");
+}
+
+static bool parse_channel_settings(const char * arg, std::vector<channel_settings> & settings)
+{
+    int channel, n;
+    if (sscanf(arg, "%d:%n", &channel, &n) != 1 || channel < 0 || channel > 1023)
+        return false;
+    if ((int) settings.size() <= channel)
+        settings.resize(channel + 1);
+    channel_settings & c = settings[channel];
+    std::string list(arg + n);
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos)
+            comma = list.size();
+        std::string item = list.substr(pos, comma - pos);
+        int len;
+        if (item == "reverse")
+            c.reverse = true;
+        else if (item == "sitor-b")
+            c.only_sitor_b = true;
+        else if (item == "compact")
+            c.compact = 1;
+        else if (item == "normal")
+            c.compact = 0;
+        else if (item == "off")
+            c.enabled = false;
+        else if (sscanf(item.c_str(), "freq=%lf%n", &c.frequency, &len) != 1 ||
+                 len != (int) item.size() || c.frequency <= 0)
+            return false;
+        pos = comma + 1;
+    }
+    return true;
+}
+
+// Read up to size bytes, fewer only at the end of the input
+static ssize_t read_full(int fd, char * buffer, size_t size)
+{
+    size_t have = 0;
+    while (have < size) {
+        ssize_t n = read(fd, buffer + have, size - have);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        have += n;
+    }
+    return have;
+}
+
+// Read the frames of a multichannel input once, split them into one
+// block per channel, and decode the channels in parallel on a channel
+// host; data_size: bytes of samples to read (-1: up to the end)
+static void decode_multichannel(int fd, long long data_size, int sample_rate,
+                                int nb_channels, std::vector<channel_settings> settings,
+                                bool compact, int decimation, int nb_threads,
+                                message_bus_writer * bus)
+{
+    settings.resize(nb_channels);
+    channel_host host(nb_threads, channel_queue_len);
+    std::vector<std::unique_ptr<block_pool>> pools(nb_channels);
+    std::vector<int> numbers(nb_channels, -1);
+    for (int c = 0; c < nb_channels; c++) {
+        if (!settings[c].enabled)
+            continue;
+        // enough blocks for a full queue, plus the ones being filled and
+        // decoded
+        pools[c].reset(new block_pool(BUFSIZE, channel_queue_len + 2));
+        const channel_settings & s = settings[c];
+        numbers[c] = host.add_channel([c, sample_rate, s, compact, decimation, bus]() {
+                                          auto rx = new channel_rx(c, sample_rate, s, compact);
+                                          if (decimation != 1)
+                                              rx->set_decimation(decimation);
+                                          if (bus != nullptr)
+                                              rx->set_message_bus(bus, c);
+                                          return rx;
+                                      },
+                                      sample_rate, channel_host::BACKGROUND);
+    }
+    host.start();
+
+    int frame_size = nb_channels * sizeof(short);
+    std::vector<short> frames((size_t) BUFSIZE * nb_channels);
+    std::vector<short> unused(BUFSIZE);
+    std::vector<sample_block *> blocks(nb_channels);
+    std::vector<short *> outputs(nb_channels);
+    long long position = 0;
+    long long left = data_size;
+    for (;;) {
+        size_t size = frames.size() * sizeof(short);
+        if (left >= 0 && (long long) size > left)
+            size = left - left % frame_size;
+        ssize_t nread = size > 0 ? read_full(fd, (char *) frames.data(), size) : 0;
+        if (nread < 0) {
+            fprintf(stderr, "read() failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        int nb_frames = nread / frame_size;
+        if (nb_frames == 0)
+            break;
+        if (left >= 0)
+            left -= nread;
+        for (int c = 0; c < nb_channels; c++) {
+            blocks[c] = pools[c] ? pools[c]->acquire() : nullptr;
+            outputs[c] = blocks[c] ? blocks[c]->data() : unused.data();
+        }
+        deinterleave(frames.data(), nb_frames, nb_channels, outputs.data());
+        for (int c = 0; c < nb_channels; c++) {
+            if (blocks[c] == nullptr)
+                continue;
+            blocks[c]->set_size(nb_frames);
+            blocks[c]->set_position(position);
+            host.push(numbers[c], blocks[c]);
+        }
+        position += nb_frames;
+        if (nread % frame_size != 0)
+            break;
+    }
+    host.finish();
+}
+
+int main(int argc, char** argv)
 {
     auto inbuf = new short[BUFSIZE];
 
+    bool compact = false;
+    int decimation = 1;
+    bool fast_scan = false;
+    const char * index_path = nullptr;
+    const char * start_pos = nullptr;
+    const char * end_pos = nullptr;
+    double preroll = default_preroll;
+    const char * clips_dir = nullptr;
+    double pre_trigger = default_pre_trigger;
+    bool sync_trigger = false;
+    const char * soft_bits_path = nullptr;
+    const char * shm_name = nullptr;
+    const char * bus_name = nullptr;
+    const char * urgent_subjects = nullptr;
+    const char * urgent_path = nullptr;
+    bool wav = false;
+    int nb_channels = 1;
+    bool channels_given = false;
+    std::vector<channel_settings> settings;
+    int nb_threads = std::thread::hardware_concurrency();
+
+    static const struct option long_options[] = {
+        { "compact",   no_argument, nullptr, 'c' },
+        { "decimate",  required_argument, nullptr, 'd' },
+        { "fast-scan", no_argument, nullptr, 'f' },
+        { "index",     required_argument, nullptr, 'i' },
+        { "start",     required_argument, nullptr, 's' },
+        { "end",       required_argument, nullptr, 'e' },
+        { "preroll",   required_argument, nullptr, 'p' },
+        { "clips",     required_argument, nullptr, 'C' },
+        { "pre-trigger", required_argument, nullptr, 'P' },
+        { "sync-trigger", no_argument,  nullptr, 'S' },
+        { "soft-bits", required_argument, nullptr, 'b' },
+        { "shm",       required_argument, nullptr, 'm' },
+        { "bus",       required_argument, nullptr, 'B' },
+        { "urgent",    required_argument, nullptr, 'u' },
+        { "urgent-file", required_argument, nullptr, 'U' },
+        { "wav",       no_argument, nullptr, 'w' },
+        { "channels",  required_argument, nullptr, 'n' },
+        { "channel",   required_argument, nullptr, 'k' },
+        { "threads",   required_argument, nullptr, 'j' },
+        { "help",      no_argument, nullptr, 'h' },
+        { nullptr,     0,           nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "cd:fi:s:e:p:C:P:Sb:m:B:u:U:wn:k:j:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'c':
+            compact = true;
+            break;
+        case 'd':
+            if (sscanf(optarg, "%d", &decimation) != 1 || decimation <= 0) {
+                fprintf(stderr, "invalid decimation: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            fast_scan = true;
+            break;
+        case 'i':
+            index_path = optarg;
+            break;
+        case 's':
+            start_pos = optarg;
+            break;
+        case 'e':
+            end_pos = optarg;
+            break;
+        case 'p':
+            if (sscanf(optarg, "%lf", &preroll) != 1 || preroll < 0) {
+                fprintf(stderr, "invalid preroll: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'C':
+            clips_dir = optarg;
+            break;
+        case 'P':
+            if (sscanf(optarg, "%lf", &pre_trigger) != 1 || pre_trigger < 0) {
+                fprintf(stderr, "invalid pre-trigger: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'S':
+            sync_trigger = true;
+            break;
+        case 'b':
+            soft_bits_path = optarg;
+            break;
+        case 'm':
+            shm_name = optarg;
+            break;
+        case 'B':
+            bus_name = optarg;
+            break;
+        case 'u':
+            urgent_subjects = optarg;
+            break;
+        case 'U':
+            urgent_path = optarg;
+            break;
+        case 'w':
+            wav = true;
+            break;
+        case 'n':
+            if (sscanf(optarg, "%d", &nb_channels) != 1 || nb_channels <= 0) {
+                fprintf(stderr, "invalid number of channels: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            channels_given = true;
+            break;
+        case 'k':
+            if (!parse_channel_settings(optarg, settings)) {
+                fprintf(stderr, "invalid channel settings: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            if (sscanf(optarg, "%d", &nb_threads) != 1 || nb_threads <= 0) {
+                fprintf(stderr, "invalid number of threads: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int nargs = argc - optind;
+    char ** args = argv + optind;
+
     int sample_rate = 11025;
-    if (argc >= 2) {
-        if (sscanf(argv[1], "%d", &sample_rate) != 1) {
-            fprintf(stderr, "invalid sample rate: %s\n", argv[1]);
+    if (nargs >= 1) {
+        if (sscanf(args[0], "%d", &sample_rate) != 1) {
+            fprintf(stderr, "invalid sample rate: %s\n", args[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    // with --wav, a sample rate of 0 is the one of the file
+    bool rate_given = nargs >= 1 && !(wav && sample_rate == 0);
+
+    shm_ring_reader ring;
+    if (shm_name != nullptr) {
+        if (nargs > 1 || fast_scan || index_path != nullptr ||
+            start_pos != nullptr || end_pos != nullptr) {
+            fprintf(stderr, "--shm cannot be used with an input file, --fast-scan, --index, --start or --end\n");
+            exit(EXIT_FAILURE);
+        }
+        if (wav || nb_channels > 1) {
+            fprintf(stderr, "--shm cannot be used with --wav or --channels\n");
+            exit(EXIT_FAILURE);
+        }
+        if (!ring.attach(shm_name)) {
+            fprintf(stderr, "cannot attach to the capture ring %s: %s\n", shm_name, strerror(errno));
             exit(EXIT_FAILURE);
         }
+        if (nargs >= 1 && sample_rate != ring.sample_rate()) {
+            fprintf(stderr, "the sample rate of the capture ring %s is %d\n", shm_name, ring.sample_rate());
+            exit(EXIT_FAILURE);
+        }
+        sample_rate = ring.sample_rate();
     }
-    
+
+    bool mapped = fast_scan || index_path != nullptr || start_pos != nullptr ||
+                  end_pos != nullptr;
+    if (mapped && (wav || nb_channels > 1)) {
+        fprintf(stderr, "--fast-scan, --index, --start and --end cannot be used with --wav or --channels\n");
+        exit(EXIT_FAILURE);
+    }
+
+    long long start = 0;
+    long long end = -1;
+    // a message in the index: the start is known once the index is loaded
+    const char * start_header = nullptr;
+    if (start_pos != nullptr && strncmp(start_pos, "header:", 7) == 0) {
+        start_header = start_pos + 7;
+        if (strlen(start_header) != 4) {
+            fprintf(stderr, "invalid start position: %s\n", start_pos);
+            exit(EXIT_FAILURE);
+        }
+        if (index_path == nullptr) {
+            fprintf(stderr, "--start=header:B1B2B3B4 needs --index\n");
+            exit(EXIT_FAILURE);
+        }
+    } else if (start_pos != nullptr && !parse_position(start_pos, sample_rate, start)) {
+        fprintf(stderr, "invalid start position: %s\n", start_pos);
+        exit(EXIT_FAILURE);
+    }
+    if (end_pos != nullptr && !parse_position(end_pos, sample_rate, end)) {
+        fprintf(stderr, "invalid end position: %s\n", end_pos);
+        exit(EXIT_FAILURE);
+    }
+
     int fd;
-    if (argc == 2 || strcmp(argv[2], "-") == 0) {
+    if (shm_name != nullptr || nargs <= 1 || strcmp(args[1], "-") == 0) {
         fd = fileno(stdin);
     } else {
         int flags = O_RDONLY;
 #ifdef O_BINARY
         flags |= O_BINARY;
 #endif
-        fd = open(argv[2], flags);
+        fd = open(args[1], flags);
         if (fd == -1) {
-            fprintf(stderr, "open(%s) failed: %s\n", argv[2], strerror(errno));
+            fprintf(stderr, "open(%s) failed: %s\n", args[1], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // bytes of samples in the input (-1: up to the end)
+    long long data_size = -1;
+    if (wav) {
+        wav_format format;
+        if (!read_wav_header(fd, format)) {
+            fprintf(stderr, "the input is not a 16 bit PCM WAV file\n");
+            exit(EXIT_FAILURE);
+        }
+        if (rate_given && sample_rate != format.sample_rate) {
+            fprintf(stderr, "the sample rate of the WAV file is %d\n", format.sample_rate);
+            exit(EXIT_FAILURE);
+        }
+        if (channels_given && nb_channels != format.nb_channels) {
+            fprintf(stderr, "the WAV file has %d channels\n", format.nb_channels);
             exit(EXIT_FAILURE);
         }
+        sample_rate = format.sample_rate;
+        nb_channels = format.nb_channels;
+        data_size = format.data_size;
+    }
+    if ((int) settings.size() > nb_channels) {
+        fprintf(stderr, "there is no channel %d in the input\n", (int) settings.size() - 1);
+        exit(EXIT_FAILURE);
+    }
+    settings.resize(nb_channels);
+
+    // the passband of the filters must fit in the decimated output
+    if (decimation != 1 &&
+        !navtex_rx(sample_rate, false, false, nullptr, nullptr, stderr).set_decimation(decimation)) {
+        fprintf(stderr, "cannot decimate by %d at %d Hz\n", decimation, sample_rate);
+        exit(EXIT_FAILURE);
+    }
+
+    if (nb_channels > 1) {
+        if (clips_dir != nullptr || soft_bits_path != nullptr || urgent_subjects != nullptr) {
+            fprintf(stderr, "--clips, --soft-bits and --urgent cannot be used with a multichannel input\n");
+            exit(EXIT_FAILURE);
+        }
+        message_bus_writer bus;
+        if (bus_name != nullptr &&
+            !bus.create(bus_name, bus_records, bus_arena_size)) {
+            fprintf(stderr, "cannot create the message bus %s: %s\n", bus_name, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        setvbuf(stdout, nullptr, _IONBF, 0);
+        decode_multichannel(fd, data_size, sample_rate, nb_channels, settings, compact,
+                            decimation, nb_threads, bus_name != nullptr ? &bus : nullptr);
+        if (bus_name != nullptr) {
+            bus.close();
+            bus.unlink();
+        }
+        if (fd != fileno(stdin))
+            close(fd);
+        return 0;
+    }
+    if (!settings[0].enabled) {
+        fprintf(stderr, "the only channel of the input cannot be off\n");
+        exit(EXIT_FAILURE);
     }
 
     // disable buffering on stdout
     setvbuf(stdout, nullptr, _IONBF, 0);
 
-    bool only_sitor_b = false;
-    bool reverse = false;
-    navtex_rx nv(sample_rate, only_sitor_b, reverse, stdout);
+    bool only_sitor_b = settings[0].only_sitor_b;
+    bool reverse = settings[0].reverse;
+    if (settings[0].compact != -1)
+        compact = settings[0].compact == 1;
+    std::unique_ptr<navtex_rx> rx;
+    if (clips_dir != nullptr) {
+        auto recorder = new clip_recorder(sample_rate, only_sitor_b, reverse,
+                                          clips_dir, pre_trigger, sync_trigger,
+                                          stdout, nullptr, stderr, compact);
+        // a recording ends when it was last written to
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+            recorder->set_start_time(st.st_mtime - st.st_size / sizeof(short) / sample_rate);
+        rx.reset(recorder);
+    } else {
+        rx.reset(new navtex_rx(sample_rate, only_sitor_b, reverse, stdout,
+                               nullptr, stderr, compact));
+    }
+    navtex_rx & nv = *rx;
+    if (settings[0].frequency > 0)
+        nv.set_center_frequency(settings[0].frequency);
+    if (decimation != 1)
+        nv.set_decimation(decimation);
+
+    message_bus_writer bus;
+    if (bus_name != nullptr) {
+        if (!bus.create(bus_name, bus_records, bus_arena_size)) {
+            fprintf(stderr, "cannot create the message bus %s: %s\n", bus_name, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        nv.set_message_bus(&bus);
+    }
 
-    while (true) {
-        auto nread = read(fd, inbuf, BUFSIZE * sizeof(short));
+    FILE * urgent_file = nullptr;
+    if (urgent_subjects != nullptr) {
+        urgent_file = stderr;
+        if (urgent_path != nullptr) {
+            urgent_file = fopen(urgent_path, "w");
+            if (urgent_file == nullptr) {
+                fprintf(stderr, "fopen(%s) failed: %s\n", urgent_path, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+        nv.set_priority_subjects(urgent_subjects, urgent_file);
+    }
+
+    FILE * soft_bits_file = nullptr;
+    softbit_writer soft_bits;
+    if (soft_bits_path != nullptr) {
+        soft_bits_file = fopen(soft_bits_path, "wb");
+        if (soft_bits_file == nullptr || !soft_bits.open(soft_bits_file, sample_rate)) {
+            fprintf(stderr, "cannot write soft bits to %s: %s\n", soft_bits_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        nv.set_soft_bit_writer(&soft_bits);
+    }
+
+    if (mapped) {
+        // the input is mapped, so that the parts of it that are skipped
+        // are never read
+        mapped_recording recording;
+        if (!recording.map(fd)) {
+            fprintf(stderr, "the input must be a non empty regular file: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (end < 0 || end > recording.nb_samples())
+            end = recording.nb_samples();
+        std::vector<activity_region> regions;
+        if (index_path != nullptr) {
+            recording_index index;
+            if (!index.load(index_path)) {
+                fprintf(stderr, "cannot load index %s\n", index_path);
+                exit(EXIT_FAILURE);
+            }
+            if (index.sample_rate != sample_rate || index.nb_samples != recording.nb_samples()) {
+                fprintf(stderr, "index %s does not match the input\n", index_path);
+                exit(EXIT_FAILURE);
+            }
+            regions = index.activity;
+            if (start_header != nullptr) {
+                const index_header * header = index.find_header(start_header);
+                if (header == nullptr) {
+                    fprintf(stderr, "message %s is not in index %s\n", start_header, index_path);
+                    exit(EXIT_FAILURE);
+                }
+                // where the decoder has settled before the message starts
+                start = header->resume;
+            }
+        } else if (fast_scan) {
+            activity_scanner scanner(sample_rate);
+            regions = scanner.scan(recording.data(), recording.nb_samples());
+        } else {
+            regions.push_back({ 0, recording.nb_samples() });
+        }
+        if (start >= recording.nb_samples()) {
+            fprintf(stderr, "start position %s is past the end of the input\n", start_pos);
+            exit(EXIT_FAILURE);
+        }
+        if (start >= end) {
+            fprintf(stderr, "the start position must come before the end position\n");
+            exit(EXIT_FAILURE);
+        }
+        // run the decoder only on the regions where there is a signal,
+        // skipping the band noise in between, and only from start to end
+        regions = clip_regions(regions, start, end);
+        if (!regions.empty()) {
+            seek_decoder(nv, recording.data(), regions.front().start,
+                         (long long) (preroll * sample_rate), BUFSIZE);
+            decode_regions(nv, recording.data(), regions, BUFSIZE);
+        }
+    }
+
+    if (shm_name != nullptr) {
+        // the decoder starts at the oldest samples in the ring
+        nv.skip_samples(ring.position());
+        while (!ring.finished()) {
+            const short * samples;
+            long long n = ring.peek(&samples, BUFSIZE);
+            if (ring.position() > nv.samples_in()) {
+                fprintf(stderr, "capture ring overrun: %lld samples lost\n",
+                        ring.position() - nv.samples_in());
+                nv.skip_samples(ring.position() - nv.samples_in());
+            }
+            if (n == 0) {
+                usleep(shm_poll_interval);
+                continue;
+            }
+            nv.process_data(samples, n);
+            if (!ring.consume(n))
+                fprintf(stderr, "capture ring overrun: %lld samples overwritten while decoding\n", n);
+        }
+    }
+
+    while (!mapped && shm_name == nullptr) {
+        size_t size = BUFSIZE * sizeof(short);
+        if (data_size >= 0 && (long long) size > data_size)
+            size = data_size;
+        auto nread = size > 0 ? read(fd, inbuf, size) : 0;
         if (nread < 0) {
             fprintf(stderr, "read() failed: %s\n", strerror(errno));
             exit(EXIT_FAILURE);
         }
         if (nread == 0)
             break;
+        if (data_size >= 0)
+            data_size -= nread;
         int nb_samples = nread / sizeof(short);
         nv.process_data(inbuf, nb_samples);
     }
+    // an urgent message still open at the end of the input
+    nv.finish();
     fflush(stdout);
 
+    if (soft_bits_file != nullptr) {
+        nv.set_soft_bit_writer(nullptr);
+        if (!soft_bits.good() || fclose(soft_bits_file) != 0) {
+            fprintf(stderr, "cannot write soft bits to %s\n", soft_bits_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (urgent_file != nullptr && urgent_file != stderr) {
+        nv.set_priority_subjects("");
+        fclose(urgent_file);
+    }
+
+    if (bus_name != nullptr) {
+        nv.set_message_bus(nullptr);
+        bus.close();
+        bus.unlink();
+    }
+
     if (fd != fileno(stdin))
         close(fd);
 
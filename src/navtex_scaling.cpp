@@ -0,0 +1,339 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// channel count scaling benchmark: run N decoders on a synthetic NAVTEX
+// signal, on a pool of threads, for N from 1 to 1000, and report the
+// aggregate throughput, the real-time margin of each channel, the memory
+// used and the last level cache miss rate, to see where the per core
+// throughput falls off as channels are added; when the hardware
+// performance counters are available, they are printed for each number
+// of channels, per input sample and per decoded character. --locality
+// shows the effect of the placement of the threads and of the decoders'
+// memory on a NUMA system (see navtex_placement.h)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "navtex_perf.h"
+#include "navtex_placement.h"
+#include "navtex_rx.h"
+
+constexpr double center_frequency = 1000.0;
+constexpr double shift = 85.0;
+constexpr double baud_rate = 100.0;
+constexpr double default_duration = 5;
+constexpr int default_block_size = 2048;
+
+// FLOATING: the threads run wherever the system puts them; PINNED: each
+// thread is pinned to a CPU, but the decoders are all built by the main
+// thread (so their memory is on its node); LOCAL: each thread is pinned,
+// and builds its own decoders, on its node
+enum locality { FLOATING, PINNED, LOCAL };
+static const char * locality_names[] = { "floating", "pinned", "local" };
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -n, --channels=LIST  comma separated numbers of decoders to run\n");
+    fprintf(stderr, "                       (default: 1,2,5,10,20,50,100,200,500,1000)\n");
+    fprintf(stderr, "  -j, --threads=N      number of threads (default: number of CPUs)\n");
+    fprintf(stderr, "  -d, --duration=S     seconds of signal decoded by each decoder\n");
+    fprintf(stderr, "                       (default: %g)\n", default_duration);
+    fprintf(stderr, "  -b, --block=N        samples passed to process_data() at a time\n");
+    fprintf(stderr, "                       (default: %d)\n", default_block_size);
+    fprintf(stderr, "  -c, --compact        compact decoders\n");
+    fprintf(stderr, "  -l, --locality=MODE  floating (default), pinned (threads pinned to\n");
+    fprintf(stderr, "                       CPUs, decoders allocated by the main thread)\n");
+    fprintf(stderr, "                       or local (threads pinned, each allocating its\n");
+    fprintf(stderr, "                       own decoders on its NUMA node)\n");
+    fprintf(stderr, "  -h, --help           show this help\n");
+}
+
+static bool parse_counts(const char * arg, std::vector<int> & counts)
+{
+    std::string list(arg);
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos)
+            comma = list.size();
+        std::string item = list.substr(pos, comma - pos);
+        int count, n;
+        if (sscanf(item.c_str(), "%d%n", &count, &n) != 1 || n != (int) item.size() ||
+            count <= 0)
+            return false;
+        counts.push_back(count);
+        pos = comma + 1;
+    }
+    return !counts.empty();
+}
+
+// A FEC transmission of a message, preceded by phasing signals, with
+// some noise, made of nb_blocks blocks of block_size samples (repeating
+// the transmission as needed)
+static std::vector<short> synthetic_signal(int sample_rate, int block_size,
+                                           long long nb_blocks)
+{
+    static const char text[] =
+        "ZCZC SA01\r\n"
+        "SYNTHETIC TRAFFIC FOR THE CHANNEL SCALING BENCHMARK\r\n"
+        "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG 0123456789\r\n"
+        "NNNN\r\n";
+    static const int phasing1 = 0x0f;
+    static const int phasing2 = 0x66;
+
+    CCIR476 ccir476;
+    std::string codes;
+    bool ex_shift = false;
+    for (const char * p = text; *p != '\0'; p++)
+        ccir476.char_to_code(codes, *p, ex_shift);
+    // the rep of each character goes 5 characters before its alpha
+    std::vector<int> transmission(200 + 2 * codes.size() + 10);
+    for (size_t i = 0; i < transmission.size(); i++)
+        transmission[i] = i % 2 ? phasing2 : phasing1;
+    for (size_t m = 0; m < codes.size(); m++) {
+        transmission[200 + 2 * m + 1] = (unsigned char) codes[m];
+        transmission[200 + 2 * m + 6] = (unsigned char) codes[m];
+    }
+
+    std::vector<short> signal(nb_blocks * block_size);
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0, 800);
+    double samples_per_bit = sample_rate / baud_rate;
+    double phase = 0;
+    for (size_t i = 0; i < signal.size(); i++) {
+        long long bit = (long long) (i / samples_per_bit);
+        int code = transmission[(bit / 7) % transmission.size()];
+        double f = center_frequency + ((code >> (bit % 7)) & 1 ? shift : -shift);
+        phase = fmod(phase + 2 * M_PI * f / sample_rate, 2 * M_PI);
+        signal[i] = std::max(-32768.0, std::min(32767.0, 8000 * sin(phase) + noise(rng)));
+    }
+    return signal;
+}
+
+static double resident_mb()
+{
+    long size, resident;
+    FILE * statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return -1;
+    int n = fscanf(statm, "%ld %ld", &size, &resident);
+    fclose(statm);
+    return n == 2 ? (double) resident * sysconf(_SC_PAGESIZE) / (1 << 20) : -1;
+}
+
+static double cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> counts;
+    int nb_threads = std::thread::hardware_concurrency();
+    double duration = default_duration;
+    int block_size = default_block_size;
+    bool compact = false;
+    locality mode = FLOATING;
+
+    static const struct option long_options[] = {
+        { "channels", required_argument, nullptr, 'n' },
+        { "threads",  required_argument, nullptr, 'j' },
+        { "duration", required_argument, nullptr, 'd' },
+        { "block",    required_argument, nullptr, 'b' },
+        { "compact",  no_argument,       nullptr, 'c' },
+        { "locality", required_argument, nullptr, 'l' },
+        { "help",     no_argument,       nullptr, 'h' },
+        { nullptr,    0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:j:d:b:cl:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'n':
+            if (!parse_counts(optarg, counts)) {
+                fprintf(stderr, "invalid numbers of channels: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            if (sscanf(optarg, "%d", &nb_threads) != 1 || nb_threads <= 0) {
+                fprintf(stderr, "invalid number of threads: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'd':
+            if (sscanf(optarg, "%lf", &duration) != 1 || duration <= 0) {
+                fprintf(stderr, "invalid duration: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            if (sscanf(optarg, "%d", &block_size) != 1 || block_size <= 0) {
+                fprintf(stderr, "invalid block size: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'c':
+            compact = true;
+            break;
+        case 'l': {
+            int m = 0;
+            while (m <= LOCAL && strcmp(optarg, locality_names[m]) != 0)
+                m++;
+            if (m > LOCAL) {
+                fprintf(stderr, "invalid locality: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            mode = (locality) m;
+            break;
+        }
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (counts.empty())
+        parse_counts("1,2,5,10,20,50,100,200,500,1000", counts);
+    nb_threads = std::max(nb_threads, 1);
+
+    int sample_rate;
+    if (sscanf(argv[optind], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    // a single copy of the input, which each channel starts reading at a
+    // different block, so that they are not all in the same phase
+    long long nb_blocks = std::max(1LL, (long long) (duration * sample_rate / block_size));
+    long long input_blocks = (long long) (30.0 * sample_rate / block_size) + 1;
+    std::vector<short> input = synthetic_signal(sample_rate, block_size, input_blocks);
+    double seconds = (double) nb_blocks * block_size / sample_rate;
+
+    perf_counters counters;
+    bool have_counters = counters.open();
+    if (!have_counters)
+        fprintf(stderr, "hardware performance counters not available\n");
+
+    std::vector<int> cpus = placement_cpus();
+    if (mode != FLOATING && cpus.empty()) {
+        fprintf(stderr, "the CPUs of the process are not known: threads left floating\n");
+        mode = FLOATING;
+    }
+    std::vector<int> nodes;
+    for (int t = 0; t < nb_threads && mode != FLOATING; t++)
+        nodes.push_back(cpu_node(cpus[t % cpus.size()]));
+    std::sort(nodes.begin(), nodes.end());
+    int nb_nodes = std::unique(nodes.begin(), nodes.end()) - nodes.begin();
+
+    printf("%d threads, %.1f s of signal per channel, blocks of %d samples%s, %s",
+           nb_threads, seconds, block_size, compact ? ", compact" : "",
+           locality_names[mode]);
+    if (mode != FLOATING)
+        printf(" on %d NUMA node%s", nb_nodes, nb_nodes > 1 ? "s" : "");
+    printf("\n");
+    printf("channels  Msamples/s  x realtime  CPU/ch (%%)  RSS (MB)  KB/ch  LLC miss  misses/ksample\n");
+    for (int nb_channels : counts) {
+        int threads_used = std::min(nb_threads, nb_channels);
+        // thread t runs on cpus[t % cpus.size()] (when it is pinned), and
+        // owns the channels t, t + threads_used, ...
+        auto pin = [&](int t) {
+            if (mode != FLOATING)
+                pin_thread(cpus[t % cpus.size()]);
+        };
+        auto build = [&](std::unique_ptr<navtex_rx> & channel) {
+            channel.reset(new navtex_rx(sample_rate, false, false, nullptr,
+                                        nullptr, nullptr, compact));
+        };
+        std::vector<std::unique_ptr<navtex_rx>> channels(nb_channels);
+        if (mode == LOCAL) {
+            std::vector<std::thread> builders;
+            for (int t = 0; t < threads_used; t++) {
+                builders.emplace_back([&, t]() {
+                    pin(t);
+                    for (int i = t; i < nb_channels; i += threads_used)
+                        build(channels[i]);
+                });
+            }
+            for (std::thread & builder : builders)
+                builder.join();
+        } else {
+            for (int i = 0; i < nb_channels; i++)
+                build(channels[i]);
+        }
+        size_t footprint = 0;
+        for (auto & channel : channels)
+            footprint += channel->footprint();
+
+        double cpu_start = cpu_seconds();
+        counters.start();
+        auto start = std::chrono::steady_clock::now();
+        // each thread runs its channels one block at a time, as a host
+        // with live inputs would
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threads_used; t++) {
+            threads.emplace_back([&, t]() {
+                pin(t);
+                for (long long b = 0; b < nb_blocks; b++) {
+                    for (int i = t; i < nb_channels; i += threads_used) {
+                        long long k = (b + i * 7919LL) % input_blocks;
+                        channels[i]->process_data(input.data() + k * block_size, block_size);
+                    }
+                }
+            });
+        }
+        for (std::thread & thread : threads)
+            thread.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        counters.stop();
+        double cpu = cpu_seconds() - cpu_start;
+        double rss = resident_mb();
+
+        double nb_samples = (double) nb_channels * nb_blocks * block_size;
+        double nb_characters = 0;
+        for (auto & channel : channels)
+            nb_characters += channel->stats().characters;
+        char miss_rate[32] = "-";
+        char misses[32] = "-";
+        long long references = counters.value(perf_counters::LLC_REFERENCES);
+        long long llc_misses = counters.value(perf_counters::LLC_MISSES);
+        if (references > 0 && llc_misses >= 0)
+            snprintf(miss_rate, sizeof(miss_rate), "%.1f%%", 100.0 * llc_misses / references);
+        if (llc_misses >= 0)
+            snprintf(misses, sizeof(misses), "%.2f", 1000.0 * llc_misses / nb_samples);
+        printf("%8d  %10.2f  %10.1f  %10.3f  %8.1f  %5.0f  %8s  %14s\n",
+               nb_channels, nb_samples / elapsed.count() / 1e6,
+               seconds / elapsed.count(), 100 * cpu / (nb_channels * seconds),
+               rss, (double) footprint / nb_channels / 1024, miss_rate, misses);
+        if (counters.available())
+            counters.report(stdout, nb_samples, nb_characters, "          ");
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_shard.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+shard_connection::shard_connection(int fd) :
+    m_fd(fd) {
+}
+
+shard_connection::~shard_connection() {
+    close(m_fd);
+}
+
+bool shard_connection::send(const std::string & fields, const char * payload,
+                            size_t length) {
+    std::string message = fields;
+    if (length > 0)
+        message += " +" + std::to_string(length);
+    message += '\n';
+    message.append(payload != nullptr ? payload : "", payload != nullptr ? length : 0);
+    const char * p = message.data();
+    size_t left = message.size();
+    while (left > 0) {
+        ssize_t n = ::send(m_fd, p, left, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+bool shard_connection::receive() {
+    char buffer[65536];
+    ssize_t n;
+    do {
+        n = recv(m_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1)
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    m_input.append(buffer, n);
+    return n > 0;
+}
+
+bool shard_connection::next(std::vector<std::string> & fields, std::string & payload) {
+    size_t end = m_input.find('\n');
+    if (end == std::string::npos)
+        return false;
+    fields.clear();
+    payload.clear();
+    size_t pos = 0;
+    while (pos < end) {
+        size_t space = m_input.find(' ', pos);
+        if (space == std::string::npos || space > end)
+            space = end;
+        fields.push_back(m_input.substr(pos, space - pos));
+        pos = space + 1;
+    }
+    size_t length = 0;
+    if (!fields.empty() && fields.back().size() > 1 && fields.back()[0] == '+') {
+        length = strtoul(fields.back().c_str() + 1, nullptr, 10);
+        // wait for the whole payload
+        if (m_input.size() < end + 1 + length)
+            return false;
+        fields.pop_back();
+        payload = m_input.substr(end + 1, length);
+    }
+    m_input.erase(0, end + 1 + length);
+    return true;
+}
+
+static bool socket_address(const std::string & path, struct sockaddr_un & address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+int shard_listen(const std::string & path) {
+    struct sockaddr_un address;
+    if (!socket_address(path, address))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+        listen(fd, 64) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int shard_connect(const std::string & path) {
+    struct sockaddr_un address;
+    if (!socket_address(path, address))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
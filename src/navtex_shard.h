@@ -0,0 +1,50 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_SHARD_H
+#define _NAVTEX_SHARD_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Connection between the decoding coordinator and one of its workers
+// (see navtex_coordinator.cpp and navtex_worker.cpp), over a stream
+// socket. A message is a line of fields separated by spaces; when the
+// last field is +N, it is followed by a payload of N bytes (the text of
+// a decoded message, for instance).
+class shard_connection {
+public:
+    // fd: a connected stream socket, which then belongs to the connection
+    explicit shard_connection(int fd);
+    ~shard_connection();
+    shard_connection(const shard_connection &) = delete;
+    shard_connection & operator=(const shard_connection &) = delete;
+
+    int fd() const { return m_fd; }
+    // Send fields, and payload if length > 0; returns false if the peer
+    // is gone
+    bool send(const std::string & fields, const char * payload = nullptr,
+              size_t length = 0);
+    // Read what the peer has sent, without waiting (call it when poll()
+    // says that the socket is readable); returns false at the end of the
+    // stream or on an error
+    bool receive();
+    // Next complete message received, if any
+    bool next(std::vector<std::string> & fields, std::string & payload);
+
+private:
+    int m_fd;
+    std::string m_input;
+}; // shard_connection
+
+// Listening socket at path (replacing a stale one), or -1
+int shard_listen(const std::string & path);
+// Socket connected to the listening socket at path, or -1
+int shard_connect(const std::string & path);
+
+#endif /* _NAVTEX_SHARD_H */
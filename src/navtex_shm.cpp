@@ -0,0 +1,205 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_shm.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[8] = { 'N', 'A', 'V', 'T', 'E', 'X', 'R', 'G' };
+static const uint32_t version = 1;
+
+// The writer stores write_start before it writes a batch of samples and
+// write_end after it, as in a seqlock: a reader that loads write_start
+// after using some samples knows whether the writer may have been
+// overwriting them in the meantime
+struct shm_ring_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> write_start;
+    std::atomic<uint64_t> write_end;
+    std::atomic<uint32_t> closed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the ring needs lock free 64 bit atomics");
+
+static const size_t samples_offset = (sizeof(shm_ring_header) + 63) & ~(size_t) 63;
+
+// shm_open() wants names starting with a slash
+static std::string shm_name(const std::string & name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+
+shm_ring_writer::shm_ring_writer() :
+    m_header(nullptr),
+    m_samples(nullptr),
+    m_size(0) {
+}
+
+shm_ring_writer::~shm_ring_writer() {
+    if (m_header != nullptr)
+        munmap(m_header, m_size);
+}
+
+bool shm_ring_writer::create(const std::string & name, int sample_rate,
+                             long long capacity) {
+    uint64_t size = 1;
+    while ((long long) size < capacity)
+        size <<= 1;
+    m_name = shm_name(name);
+    m_size = samples_offset + size * sizeof(short);
+
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd == -1)
+        return false;
+    // start from a clean (zeroed) ring, even if the name was left behind
+    // by a previous writer
+    bool ok = ftruncate(fd, 0) == 0 && ftruncate(fd, m_size) == 0;
+    void * addr = ok ? mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+
+    m_header = new (addr) shm_ring_header();
+    m_header->version = version;
+    m_header->sample_rate = sample_rate;
+    m_header->capacity = size;
+    m_samples = reinterpret_cast<short *>(static_cast<char *>(addr) + samples_offset);
+    // the magic goes last, so that a reader never sees a half built header
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_header->magic, magic, sizeof(magic));
+    return true;
+}
+
+void shm_ring_writer::write(const short * data, long long nb_samples) {
+    uint64_t capacity = m_header->capacity;
+    uint64_t position = m_header->write_end.load(std::memory_order_relaxed);
+    // only the last capacity samples of a large batch fit
+    if ((uint64_t) nb_samples > capacity) {
+        position += nb_samples - capacity;
+        data += nb_samples - capacity;
+        nb_samples = capacity;
+    }
+    uint64_t end = position + nb_samples;
+    m_header->write_start.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    while (position < end) {
+        uint64_t index = position & (capacity - 1);
+        uint64_t n = std::min(end - position, capacity - index);
+        memcpy(m_samples + index, data, n * sizeof(short));
+        data += n;
+        position += n;
+    }
+    m_header->write_end.store(end, std::memory_order_release);
+}
+
+void shm_ring_writer::close() {
+    m_header->closed.store(1, std::memory_order_release);
+}
+
+void shm_ring_writer::unlink() {
+    shm_unlink(m_name.c_str());
+}
+
+
+shm_ring_reader::shm_ring_reader() :
+    m_header(nullptr),
+    m_samples(nullptr),
+    m_size(0),
+    m_capacity(0),
+    m_cursor(0),
+    m_lost(0) {
+}
+
+shm_ring_reader::~shm_ring_reader() {
+    if (m_header != nullptr)
+        munmap(const_cast<shm_ring_header *>(m_header), m_size);
+}
+
+bool shm_ring_reader::attach(const std::string & name) {
+    int fd = shm_open(shm_name(name).c_str(), O_RDONLY, 0);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    void * addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size > samples_offset) {
+        m_size = st.st_size;
+        addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    m_header = static_cast<const shm_ring_header *>(addr);
+    bool ok = memcmp(m_header->magic, magic, sizeof(magic)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    ok = ok && m_header->version == version &&
+         samples_offset + m_header->capacity * sizeof(short) == m_size;
+    if (!ok) {
+        munmap(addr, m_size);
+        m_header = nullptr;
+        return false;
+    }
+    m_samples = reinterpret_cast<const short *>(static_cast<const char *>(addr) +
+                                                samples_offset);
+    m_capacity = m_header->capacity;
+    long long start = m_header->write_start.load(std::memory_order_acquire);
+    m_cursor = std::max(0LL, start - m_capacity);
+    m_lost = 0;
+    return true;
+}
+
+int shm_ring_reader::sample_rate() const {
+    return m_header->sample_rate;
+}
+
+long long shm_ring_reader::peek(const short ** data, long long max_samples) {
+    long long end = m_header->write_end.load(std::memory_order_acquire);
+    // the samples the writer may be overwriting now are before
+    // write_start - capacity
+    long long oldest = (long long) m_header->write_start.load(std::memory_order_relaxed) -
+                       m_capacity;
+    if (m_cursor < oldest) {
+        m_lost += oldest - m_cursor;
+        m_cursor = oldest;
+    }
+    long long index = m_cursor & (m_capacity - 1);
+    long long n = std::min(std::min(end - m_cursor, max_samples), m_capacity - index);
+    if (n <= 0)
+        return 0;
+    *data = m_samples + index;
+    return n;
+}
+
+bool shm_ring_reader::consume(long long nb_samples) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    long long oldest = (long long) m_header->write_start.load(std::memory_order_relaxed) -
+                       m_capacity;
+    bool ok = oldest <= m_cursor;
+    if (!ok)
+        m_lost += std::min(nb_samples, oldest - m_cursor);
+    m_cursor += nb_samples;
+    return ok;
+}
+
+bool shm_ring_reader::finished() const {
+    return m_header->closed.load(std::memory_order_acquire) &&
+           m_cursor >= (long long) m_header->write_end.load(std::memory_order_acquire);
+}
@@ -0,0 +1,86 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_SHM_H
+#define _NAVTEX_SHM_H
+
+#include <cstddef>
+#include <string>
+
+struct shm_ring_header;
+
+// Capture ring in POSIX shared memory: one process writes the samples,
+// any number of processes decode them straight from the mapped ring,
+// without a copy or a system call per buffer.
+//
+// The writer never waits for the readers: each reader keeps its own
+// cursor, and finds out when the writer has overwritten samples it had
+// not read yet (an overrun). The ring is a header followed by a power
+// of two number of signed 16 bit samples; positions in the stream are
+// counted from the first sample written, and a sample at position p is
+// at index p % capacity in the ring.
+class shm_ring_writer {
+public:
+    shm_ring_writer();
+    ~shm_ring_writer();
+    shm_ring_writer(const shm_ring_writer &) = delete;
+    shm_ring_writer & operator=(const shm_ring_writer &) = delete;
+
+    // Create the ring /name, with room for at least capacity samples
+    bool create(const std::string & name, int sample_rate, long long capacity);
+    void write(const short * data, long long nb_samples);
+    // Tell the readers that no more samples will come
+    void close();
+    // Remove the name (the readers that have it mapped keep it)
+    void unlink();
+
+private:
+    std::string m_name;
+    shm_ring_header * m_header;
+    short * m_samples;
+    size_t m_size;
+}; // shm_ring_writer
+
+class shm_ring_reader {
+public:
+    shm_ring_reader();
+    ~shm_ring_reader();
+    shm_ring_reader(const shm_ring_reader &) = delete;
+    shm_ring_reader & operator=(const shm_ring_reader &) = delete;
+
+    // Attach to the ring /name; reading starts from the oldest samples
+    // still in the ring
+    bool attach(const std::string & name);
+    int sample_rate() const;
+    long long capacity() const { return m_capacity; }
+
+    // Up to max_samples samples from the cursor on, contiguous in the
+    // ring; returns how many (0 if there are none yet). If the writer
+    // has lapped the cursor, the cursor first jumps to the oldest
+    // samples still in the ring, and lost() grows.
+    long long peek(const short ** data, long long max_samples);
+    // Move the cursor past nb_samples samples returned by peek(); returns
+    // false if the writer may have overwritten them while they were in
+    // use (an overrun: the samples are counted in lost())
+    bool consume(long long nb_samples);
+    // position of the cursor in the stream
+    long long position() const { return m_cursor; }
+    // the writer has closed the ring and all the samples have been read
+    bool finished() const;
+    // samples lost to overruns
+    long long lost() const { return m_lost; }
+
+private:
+    const shm_ring_header * m_header;
+    const short * m_samples;
+    size_t m_size;
+    long long m_capacity;
+    long long m_cursor;
+    long long m_lost;
+}; // shm_ring_reader
+
+#endif /* _NAVTEX_SHM_H */
@@ -0,0 +1,146 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// write NAVTEX sound files (signed LE16), or the standard input, to a
+// shared memory capture ring, to be decoded by one or more
+// 'navtex_rx_from_file --shm' processes; the files are replayed in real
+// time unless --fast is given
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "navtex_shm.h"
+
+constexpr int BUFSIZE = 8192;
+constexpr double default_ring_seconds = 60;
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] name sample_rate [file|-]...\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -s, --size=S  ring size in seconds of samples (default: %g)\n", default_ring_seconds);
+    fprintf(stderr, "  -f, --fast    write the samples as fast as possible, instead of in\n");
+    fprintf(stderr, "                real time\n");
+    fprintf(stderr, "  -k, --keep    do not remove the ring at the end, so that readers can\n");
+    fprintf(stderr, "                still attach to it\n");
+    fprintf(stderr, "  -h, --help    show this help\n");
+}
+
+// wait until the samples written so far are due
+static void pace(const struct timespec & start, long long nb_samples, int sample_rate)
+{
+    struct timespec due = start;
+    due.tv_sec += nb_samples / sample_rate;
+    due.tv_nsec += (nb_samples % sample_rate) * 1000000000LL / sample_rate;
+    if (due.tv_nsec >= 1000000000L) {
+        due.tv_sec++;
+        due.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, nullptr) == EINTR)
+        ;
+}
+
+int main(int argc, char** argv)
+{
+    double ring_seconds = default_ring_seconds;
+    bool fast = false;
+    bool keep = false;
+
+    static const struct option long_options[] = {
+        { "size", required_argument, nullptr, 's' },
+        { "fast", no_argument,       nullptr, 'f' },
+        { "keep", no_argument,       nullptr, 'k' },
+        { "help", no_argument,       nullptr, 'h' },
+        { nullptr, 0,                nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:fkh", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 's':
+            if (sscanf(optarg, "%lf", &ring_seconds) != 1 || ring_seconds <= 0) {
+                fprintf(stderr, "invalid size: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            fast = true;
+            break;
+        case 'k':
+            keep = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int nargs = argc - optind;
+    char ** args = argv + optind;
+    if (nargs < 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const char * name = args[0];
+    int sample_rate;
+    if (sscanf(args[1], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", args[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    shm_ring_writer ring;
+    if (!ring.create(name, sample_rate, (long long) (ring_seconds * sample_rate))) {
+        fprintf(stderr, "cannot create the capture ring %s: %s\n", name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    auto inbuf = new short[BUFSIZE];
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long written = 0;
+    int nb_files = nargs > 2 ? nargs - 2 : 1;
+    for (int i = 0; i < nb_files; i++) {
+        const char * path = nargs > 2 ? args[2 + i] : "-";
+        int fd = fileno(stdin);
+        if (strcmp(path, "-") != 0) {
+            fd = open(path, O_RDONLY);
+            if (fd == -1) {
+                fprintf(stderr, "open(%s) failed: %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (;;) {
+            auto nread = read(fd, inbuf, BUFSIZE * sizeof(short));
+            if (nread < 0) {
+                fprintf(stderr, "read() failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            if (nread == 0)
+                break;
+            int nb_samples = nread / sizeof(short);
+            if (!fast)
+                pace(start, written, sample_rate);
+            ring.write(inbuf, nb_samples);
+            written += nb_samples;
+        }
+        if (fd != fileno(stdin))
+            close(fd);
+    }
+
+    ring.close();
+    if (!keep)
+        ring.unlink();
+
+    return 0;
+}
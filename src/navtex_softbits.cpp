@@ -0,0 +1,120 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "navtex_softbits.h"
+#include "navtex_rx.h"
+#include <climits>
+#include <cstring>
+
+static const char magic[8] = { 'N', 'A', 'V', 'T', 'E', 'X', 'S', 'B' };
+static const unsigned version = 1;
+static const int event_marker = SHRT_MIN;
+
+enum softbit_event { EVENT_POSITION, EVENT_GAP, EVENT_MUTED, EVENT_UNMUTED };
+
+static void put_le(unsigned char * buf, unsigned long long v, int len) {
+    for (int i = 0; i < len; i++)
+        buf[i] = v >> (8 * i);
+}
+
+static unsigned long long get_le(const unsigned char * buf, int len) {
+    unsigned long long v = 0;
+    for (int i = 0; i < len; i++)
+        v |= (unsigned long long) buf[i] << (8 * i);
+    return v;
+}
+
+softbit_writer::softbit_writer() :
+    m_file(nullptr),
+    m_last_sample(0) {
+}
+
+bool softbit_writer::open(FILE * file, int sample_rate) {
+    unsigned char header[16];
+    memcpy(header, magic, sizeof(magic));
+    put_le(header + 8, version, 4);
+    put_le(header + 12, sample_rate, 4);
+    m_file = file;
+    m_last_sample = 0;
+    return fwrite(header, sizeof(header), 1, m_file) == 1;
+}
+
+bool softbit_writer::good() const {
+    return m_file != nullptr && !ferror(m_file);
+}
+
+void softbit_writer::put(long long sample, int value) {
+    long long delta = sample - m_last_sample;
+    if (delta < 0 || delta > USHRT_MAX) {
+        put_event(EVENT_POSITION, sample);
+        delta = 0;
+    }
+    // the same clamping as the back end
+    if (value < SHRT_MIN + 1) value = SHRT_MIN + 1;
+    if (value > SHRT_MAX) value = SHRT_MAX;
+    unsigned char record[4];
+    put_le(record, (unsigned short) value, 2);
+    put_le(record + 2, delta, 2);
+    fwrite(record, sizeof(record), 1, m_file);
+    m_last_sample = sample;
+}
+
+void softbit_writer::put_gap(long long sample) {
+    put_event(EVENT_GAP, sample);
+}
+
+void softbit_writer::put_muted(long long sample, bool muted) {
+    put_event(muted ? EVENT_MUTED : EVENT_UNMUTED, sample);
+}
+
+void softbit_writer::put_event(int type, long long sample) {
+    unsigned char record[12];
+    put_le(record, (unsigned short) event_marker, 2);
+    put_le(record + 2, type, 2);
+    put_le(record + 4, sample, 8);
+    fwrite(record, sizeof(record), 1, m_file);
+    m_last_sample = sample;
+}
+
+bool replay_soft_bits(navtex_rx & rx, FILE * file, int sample_rate) {
+    unsigned char header[16];
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+        memcmp(header, magic, sizeof(magic)) != 0 ||
+        get_le(header + 8, 4) != version ||
+        (int) get_le(header + 12, 4) != sample_rate)
+        return false;
+
+    long long sample = 0;
+    unsigned char record[4];
+    while (fread(record, sizeof(record), 1, file) == 1) {
+        int value = (short) get_le(record, 2);
+        unsigned arg = get_le(record + 2, 2);
+        if (value != event_marker) {
+            sample += arg;
+            rx.process_soft_bit(sample, value);
+            continue;
+        }
+        unsigned char position[8];
+        if (fread(position, sizeof(position), 1, file) != 1)
+            return false;
+        sample = get_le(position, 8);
+        switch (arg) {
+        case EVENT_POSITION:
+            break;
+        case EVENT_GAP:
+            rx.process_soft_bit_gap(sample);
+            break;
+        case EVENT_MUTED:
+        case EVENT_UNMUTED:
+            rx.set_muted(arg == EVENT_MUTED);
+            break;
+        default:
+            return false;
+        }
+    }
+    return !ferror(file);
+}
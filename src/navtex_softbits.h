@@ -0,0 +1,61 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef _NAVTEX_SOFTBITS_H
+#define _NAVTEX_SOFTBITS_H
+
+#include <cstdio>
+
+class navtex_rx;
+
+// Soft bit dump: the values the front end (filters, envelope trackers
+// and bit sync) passes to the back end (character sync, FEC, messages),
+// one per bit, with the sample where each bit was taken. Replaying a
+// dump runs only the back end, so that its parameters can be tuned
+// without going through the audio again; at 100 bits/s a dump is about
+// 400 bytes per second of signal.
+//
+// The file starts with a 16 byte header:
+//   "NAVTEXSB"  magic
+//   uint32      version (1)
+//   uint32      sample rate
+// followed by 4 byte records, all little endian:
+//   int16       bit value
+//   uint16      samples since the previous record
+// A bit value of -32768 (which the front end never produces) marks an
+// event record, where the second field is the event type, followed by
+// the int64 sample of the event:
+//   0           position (the next bit is too far from the previous one)
+//   1           gap in the input (skip_samples())
+//   2, 3        decoder muted, unmuted
+class softbit_writer {
+public:
+    softbit_writer();
+    softbit_writer(const softbit_writer &) = delete;
+    softbit_writer & operator=(const softbit_writer &) = delete;
+
+    // Start a dump in file (which is not closed by the writer)
+    bool open(FILE * file, int sample_rate);
+    // false once a write has failed
+    bool good() const;
+
+    void put(long long sample, int value);
+    void put_gap(long long sample);
+    void put_muted(long long sample, bool muted);
+
+private:
+    FILE * m_file;
+    long long m_last_sample;
+
+    void put_event(int type, long long sample);
+}; // softbit_writer
+
+// Run the back end of rx on the soft bit dump in file; returns false if
+// the file is not a valid dump, or was written at a different sample rate
+bool replay_soft_bits(navtex_rx & rx, FILE * file, int sample_rate);
+
+#endif /* _NAVTEX_SOFTBITS_H */
@@ -0,0 +1,246 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// whole band search for NAVTEX signals in a wideband recording (signed
+// LE16, real): the average power spectrum of the recording, computed
+// with large transforms (see navtex_fft.h), is searched for the two
+// tones of a NAVTEX transmitter, 170 Hz apart, standing out of the
+// noise floor; their center frequencies (to give to the decoders, as
+// their center frequency) are printed with their signal to noise ratio.
+// With --benchmark, the time of a transform of the chosen size is
+// measured instead, with parallel_fft and with the serial g_fft.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "gfft.h"
+#include "navtex_fft.h"
+#include "navtex_recording.h"
+
+constexpr int default_size = 65536;
+constexpr double default_snr = 10;
+constexpr double shift = 170;
+// bandwidth of each tone of a 100 baud FSK signal, for the power
+constexpr double tone_bandwidth = 40;
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate file\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -n, --size=N       points of the transforms (default: %d)\n",
+            default_size);
+    fprintf(stderr, "  -j, --threads=N    number of threads (default: number of CPUs)\n");
+    fprintf(stderr, "  -s, --snr=DB       signal to noise ratio of each tone, in %g Hz,\n",
+            tone_bandwidth);
+    fprintf(stderr, "                     for a signal to be reported (default: %g)\n",
+            default_snr);
+    fprintf(stderr, "  -b, --benchmark    time the transforms instead\n");
+    fprintf(stderr, "  -h, --help         show this help\n");
+}
+
+// Average power spectrum (bins 0 to N/2) of the real samples, with a
+// Hann window; two frames go through each complex transform, one as the
+// real part and one as the imaginary part
+static std::vector<double> power_spectrum(parallel_fft & fft, const short * data,
+                                          long long nb_samples)
+{
+    int n = fft.size();
+    std::vector<double> window(n);
+    for (int i = 0; i < n; i++)
+        window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+    std::vector<std::complex<double>> frame(n);
+    std::vector<double> power(n / 2 + 1, 0);
+    long long nb_frames = nb_samples / n;
+    for (long long f = 0; f < nb_frames; f += 2) {
+        const short * a = data + f * n;
+        const short * b = f + 1 < nb_frames ? a + n : nullptr;
+        for (int i = 0; i < n; i++)
+            frame[i] = std::complex<double>(a[i] * window[i], b ? b[i] * window[i] : 0);
+        fft.forward(frame.data());
+        // A[k] = (X[k] + conj(X[N-k])) / 2, B[k] = (X[k] - conj(X[N-k])) / 2i
+        for (int k = 0; k <= n / 2; k++) {
+            std::complex<double> x = frame[k];
+            std::complex<double> y = std::conj(frame[(n - k) % n]);
+            power[k] += std::norm(x + y) / 4;
+            if (b)
+                power[k] += std::norm(x - y) / 4;
+        }
+    }
+    for (double & p : power)
+        p /= std::max(nb_frames, 1LL);
+    return power;
+}
+
+static void benchmark(int size, int nb_threads)
+{
+    parallel_fft fft(size, nb_threads);
+    g_fft<double> serial(fft.size());
+    std::vector<std::complex<double>> data(fft.size());
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = std::complex<double>(sin(0.1 * i), 0);
+    int repeats = std::max(1, (1 << 24) / fft.size());
+    auto time = [&](const std::function<void()> & transform) {
+        transform();
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++)
+            transform();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / repeats;
+    };
+    double parallel_time = time([&]() { fft.forward(data.data()); });
+    double serial_time = time([&]() { serial.ComplexFFT(data.data()); });
+    printf("%d points, %d threads\n", fft.size(), nb_threads);
+    printf("parallel_fft  %9.3f ms\n", 1000 * parallel_time);
+    printf("g_fft         %9.3f ms\n", 1000 * serial_time);
+    printf("speedup       %9.2f\n", serial_time / parallel_time);
+}
+
+int main(int argc, char** argv)
+{
+    int size = default_size;
+    int nb_threads = std::thread::hardware_concurrency();
+    double snr = default_snr;
+    bool bench = false;
+
+    static const struct option long_options[] = {
+        { "size",      required_argument, nullptr, 'n' },
+        { "threads",   required_argument, nullptr, 'j' },
+        { "snr",       required_argument, nullptr, 's' },
+        { "benchmark", no_argument,       nullptr, 'b' },
+        { "help",      no_argument,       nullptr, 'h' },
+        { nullptr,     0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:j:s:bh", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'n':
+            if (sscanf(optarg, "%d", &size) != 1 || size < 16 || (size & (size - 1)) != 0) {
+                fprintf(stderr, "invalid size (a power of two is needed): %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            if (sscanf(optarg, "%d", &nb_threads) != 1 || nb_threads <= 0) {
+                fprintf(stderr, "invalid number of threads: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            if (sscanf(optarg, "%lf", &snr) != 1) {
+                fprintf(stderr, "invalid signal to noise ratio: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            bench = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    nb_threads = std::max(nb_threads, 1);
+    if (bench) {
+        benchmark(size, nb_threads);
+        return 0;
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int sample_rate;
+    if (sscanf(argv[optind], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    const char * path = argv[optind + 1];
+    int fd = open(path, O_RDONLY);
+    mapped_recording recording;
+    if (fd == -1 || !recording.map(fd)) {
+        fprintf(stderr, "cannot map %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (recording.nb_samples() < size) {
+        fprintf(stderr, "%s is shorter than a transform (%d samples)\n", path, size);
+        exit(EXIT_FAILURE);
+    }
+
+    parallel_fft fft(size, nb_threads);
+    std::vector<double> power = power_spectrum(fft, recording.data(), recording.nb_samples());
+    int nb_bins = power.size();
+    double bin_width = (double) sample_rate / size;
+
+    // power in tone_bandwidth around each bin, from the running sums, and
+    // the noise floor in the same bandwidth (the median of them)
+    std::vector<double> sums(nb_bins + 1, 0);
+    for (int k = 0; k < nb_bins; k++)
+        sums[k + 1] = sums[k] + power[k];
+    int half = std::max(1, (int) (tone_bandwidth / bin_width / 2));
+    auto band = [&](int k) {
+        int lo = std::max(0, k - half);
+        int hi = std::min(nb_bins, k + half + 1);
+        return sums[hi] - sums[lo];
+    };
+    std::vector<double> bands(nb_bins);
+    for (int k = 0; k < nb_bins; k++)
+        bands[k] = band(k);
+    std::vector<double> sorted = bands;
+    std::nth_element(sorted.begin(), sorted.begin() + nb_bins / 2, sorted.end());
+    double floor = std::max(sorted[nb_bins / 2], 1e-30);
+    double threshold = floor * pow(10, snr / 10);
+
+    // a candidate has both tones above the threshold, and less power
+    // between them than in either; a run of adjacent candidates is one
+    // signal, centered in the middle of the run
+    int offset = (int) lround(shift / 2 / bin_width);
+    printf("%.0f Hz to %.0f Hz, %.3f Hz bins, %lld transforms of %d points, noise floor %.1f dB\n",
+           0.0, sample_rate / 2.0, bin_width, recording.nb_samples() / size, size,
+           10 * log10(floor));
+    printf("center (Hz)  SNR (dB)  space (dB)  mark (dB)\n");
+    int first = -1;
+    int last = -1;
+    auto report = [&]() {
+        if (first == -1)
+            return;
+        int center = (first + last) / 2;
+        double space = bands[center - offset] / floor;
+        double mark = bands[center + offset] / floor;
+        printf("%11.1f  %8.1f  %10.1f  %9.1f\n", (first + last) / 2.0 * bin_width,
+               10 * log10(std::min(space, mark)), 10 * log10(space), 10 * log10(mark));
+        first = -1;
+    };
+    for (int k = offset; k + offset < nb_bins; k++) {
+        double score = std::min(bands[k - offset], bands[k + offset]);
+        if (score > threshold && bands[k] < score) {
+            if (first == -1)
+                first = k;
+            last = k;
+        } else if (first != -1 && k - last > offset) {
+            report();
+        }
+    }
+    report();
+    close(fd);
+
+    return 0;
+}
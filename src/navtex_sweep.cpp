@@ -0,0 +1,288 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// decode a NAVTEX recording (signed LE16) under many decoder
+// configurations at once, to find the best settings for a receiver:
+// the input is read once, and shared by decoders running on a pool of
+// threads; the configurations are ranked by the messages they decoded
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "navtex_perf.h"
+#include "navtex_recording.h"
+#include "navtex_rx.h"
+
+constexpr int BUFSIZE = 8192;
+constexpr double center_frequency = 1000.0;
+
+struct sweep_config {
+    double offset;
+    bool reverse;
+    bool compact;
+    navtex_stats stats;
+};
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] sample_rate [file|-]\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -o, --offsets=LIST   center frequency offsets in Hz: a comma separated\n");
+    fprintf(stderr, "                       list of values and start:stop:step ranges\n");
+    fprintf(stderr, "                       (default: -50:50:10)\n");
+    fprintf(stderr, "  -p, --polarity=P     normal, reverse or both (default: both)\n");
+    fprintf(stderr, "  -e, --engines=E      normal, compact or both (default: both)\n");
+    fprintf(stderr, "  -j, --threads=N      number of threads (default: number of CPUs)\n");
+    fprintf(stderr, "  -h, --help           show this help\n");
+}
+
+static bool parse_offsets(const char * arg, std::vector<double> & offsets)
+{
+    std::string list(arg);
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos)
+            comma = list.size();
+        std::string item = list.substr(pos, comma - pos);
+        double start, stop, step;
+        int n;
+        if (sscanf(item.c_str(), "%lf:%lf:%lf%n", &start, &stop, &step, &n) == 3 &&
+            n == (int) item.size()) {
+            if (step <= 0 || stop < start)
+                return false;
+            for (int k = 0; start + k * step <= stop + step * 1e-6; k++)
+                offsets.push_back(start + k * step);
+        } else if (sscanf(item.c_str(), "%lf%n", &start, &n) == 1 &&
+                   n == (int) item.size()) {
+            offsets.push_back(start);
+        } else {
+            return false;
+        }
+        pos = comma + 1;
+    }
+    return !offsets.empty();
+}
+
+// "normal", "<other>" or "both" -> which of the two to use
+static bool parse_choice(const char * arg, const char * other, bool & first, bool & second)
+{
+    first = strcmp(arg, "normal") == 0 || strcmp(arg, "both") == 0;
+    second = strcmp(arg, other) == 0 || strcmp(arg, "both") == 0;
+    return first || second;
+}
+
+static void decode(sweep_config & config, int sample_rate, const short * data,
+                   long long nb_samples)
+{
+    navtex_rx nv(sample_rate, false, config.reverse, nullptr, nullptr, nullptr,
+                 config.compact);
+    nv.set_center_frequency(center_frequency + config.offset);
+    for (long long i = 0; i < nb_samples; i += BUFSIZE)
+        nv.process_data(data + i, std::min((long long) BUFSIZE, nb_samples - i));
+    config.stats = nv.stats();
+}
+
+static double failure_rate(const navtex_stats & stats)
+{
+    return stats.characters > 0 ? (double) stats.fec_failures / stats.characters : 1.0;
+}
+
+// characters recovered, the ones of noise fragments included
+static long long clean_characters(const navtex_stats & stats)
+{
+    return stats.characters - stats.fec_failures;
+}
+
+// more complete messages and headers, then more clean characters (the
+// message count includes the fragments decoded from noise, which a
+// detuned configuration can have more of), then fewer FEC failures, then
+// earlier sync
+static bool better(const sweep_config & a, const sweep_config & b)
+{
+    if (a.stats.complete_messages != b.stats.complete_messages)
+        return a.stats.complete_messages > b.stats.complete_messages;
+    if (a.stats.headers != b.stats.headers)
+        return a.stats.headers > b.stats.headers;
+    if (clean_characters(a.stats) != clean_characters(b.stats))
+        return clean_characters(a.stats) > clean_characters(b.stats);
+    if (failure_rate(a.stats) != failure_rate(b.stats))
+        return failure_rate(a.stats) < failure_rate(b.stats);
+    long long la = a.stats.first_lock < 0 ? LLONG_MAX : a.stats.first_lock;
+    long long lb = b.stats.first_lock < 0 ? LLONG_MAX : b.stats.first_lock;
+    return la < lb;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<double> offsets;
+    bool normal = true, reverse = true;
+    bool normal_engine = true, compact_engine = true;
+    int nb_threads = std::thread::hardware_concurrency();
+
+    static const struct option long_options[] = {
+        { "offsets",  required_argument, nullptr, 'o' },
+        { "polarity", required_argument, nullptr, 'p' },
+        { "engines",  required_argument, nullptr, 'e' },
+        { "threads",  required_argument, nullptr, 'j' },
+        { "help",     no_argument,       nullptr, 'h' },
+        { nullptr,    0,                 nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:p:e:j:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'o':
+            if (!parse_offsets(optarg, offsets)) {
+                fprintf(stderr, "invalid offsets: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            if (!parse_choice(optarg, "reverse", normal, reverse)) {
+                fprintf(stderr, "invalid polarity: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'e':
+            if (!parse_choice(optarg, "compact", normal_engine, compact_engine)) {
+                fprintf(stderr, "invalid engines: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            if (sscanf(optarg, "%d", &nb_threads) != 1 || nb_threads <= 0) {
+                fprintf(stderr, "invalid number of threads: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int nargs = argc - optind;
+    char ** args = argv + optind;
+    if (nargs < 1 || nargs > 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (offsets.empty())
+        parse_offsets("-50:50:10", offsets);
+    nb_threads = std::max(nb_threads, 1);
+
+    int sample_rate;
+    if (sscanf(args[0], "%d", &sample_rate) != 1 || sample_rate <= 0) {
+        fprintf(stderr, "invalid sample rate: %s\n", args[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = fileno(stdin);
+    if (nargs == 2 && strcmp(args[1], "-") != 0) {
+        fd = open(args[1], O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "open(%s) failed: %s\n", args[1], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // the input is read once, and shared by all the decoders: mapped if
+    // it is a regular file, read into memory otherwise
+    mapped_recording recording;
+    std::vector<short> samples;
+    const short * data;
+    long long nb_samples;
+    if (recording.map(fd)) {
+        data = recording.data();
+        nb_samples = recording.nb_samples();
+    } else {
+        std::vector<char> buf(BUFSIZE * sizeof(short));
+        std::vector<char> bytes;
+        ssize_t nread;
+        while ((nread = read(fd, buf.data(), buf.size())) > 0)
+            bytes.insert(bytes.end(), buf.begin(), buf.begin() + nread);
+        if (nread < 0) {
+            fprintf(stderr, "read() failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        samples.resize(bytes.size() / sizeof(short));
+        memcpy(samples.data(), bytes.data(), samples.size() * sizeof(short));
+        data = samples.data();
+        nb_samples = samples.size();
+    }
+
+    std::vector<sweep_config> configs;
+    for (double offset : offsets) {
+        for (int r = 0; r < 2; r++) {
+            if (!(r ? reverse : normal))
+                continue;
+            for (int c = 0; c < 2; c++) {
+                if (!(c ? compact_engine : normal_engine))
+                    continue;
+                configs.push_back({ offset, r == 1, c == 1, navtex_stats() });
+            }
+        }
+    }
+
+    perf_counters counters;
+    counters.open();
+    counters.start();
+    // each thread takes the next configuration to decode
+    std::atomic<size_t> next_config(0);
+    std::vector<std::thread> threads;
+    size_t nb = std::min<size_t>(nb_threads, configs.size());
+    for (size_t t = 0; t < nb; t++) {
+        threads.emplace_back([&]() {
+            size_t k;
+            while ((k = next_config++) < configs.size())
+                decode(configs[k], sample_rate, data, nb_samples);
+        });
+    }
+    for (std::thread & thread : threads)
+        thread.join();
+    counters.stop();
+
+    double nb_characters = 0;
+    for (const sweep_config & config : configs)
+        nb_characters += config.stats.characters;
+
+    std::stable_sort(configs.begin(), configs.end(), better);
+    printf("rank  offset  polarity  engine   headers  messages  complete  characters  FEC fail  sync (s)\n");
+    int rank = 1;
+    for (const sweep_config & config : configs) {
+        const navtex_stats & stats = config.stats;
+        char sync[32] = "-";
+        if (stats.first_lock >= 0)
+            snprintf(sync, sizeof(sync), "%.1f", (double) stats.first_lock / sample_rate);
+        printf("%4d  %+6.0f  %-8s  %-7s  %7lld  %8lld  %8lld  %10lld  %7.1f%%  %8s\n",
+               rank++, config.offset, config.reverse ? "reverse" : "normal",
+               config.compact ? "compact" : "normal", stats.headers,
+               stats.messages, stats.complete_messages, stats.characters,
+               100 * failure_rate(stats), sync);
+    }
+    if (counters.available()) {
+        printf("\nhardware performance counters, all configurations:\n");
+        counters.report(stdout, (double) nb_samples * configs.size(), nb_characters);
+    }
+
+    if (fd != fileno(stdin))
+        close(fd);
+
+    return 0;
+}
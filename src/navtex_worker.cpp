@@ -0,0 +1,283 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// decoding worker of navtex_coordinator: connects to the coordinator's
+// socket, decodes the channels (raw recordings, signed LE16) it is
+// assigned, from the position it is given, and sends back the messages,
+// checkpoints and statistics. The worker has no state that the
+// coordinator cannot rebuild: when it goes away, its channels resume
+// elsewhere from their last checkpoint.
+//
+// Coordinator to worker:
+//   assign <channel> <sample_rate> <start> <speed> <path>
+//   revoke <channel>
+//   quit
+// Worker to coordinator:
+//   hello <pid>
+//   message <channel> <sample> +<length>   (followed by the text)
+//   checkpoint <channel> <sample>
+//   stats <channel> <position> <cpu_seconds>
+//   load <fraction of a CPU used since the last load>
+//   done <channel> <position>
+//   revoked <channel> <checkpoint>
+//   error <channel> <reason>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+#include "navtex_index.h"
+#include "navtex_recording.h"
+#include "navtex_rx.h"
+#include "navtex_shard.h"
+
+constexpr int block_size = 4096;
+// seconds of signal between checkpoints, and of wall clock time between
+// statistics
+constexpr double checkpoint_interval = 10;
+constexpr double stats_interval = 1;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_seconds(int who)
+{
+    struct timespec ts;
+    clock_gettime(who, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// navtex_rx that sends its messages to the coordinator, and remembers
+// where its current lock on a signal started, and where the lock in which
+// the text it has not delivered yet started: a checkpoint goes back
+// there, so that a message in progress, or received but not delivered
+// yet (a message without NNNN is only delivered by the next header or by
+// the timeout, long after the end of the signal), is decoded in full by
+// whoever resumes the channel
+class worker_rx : public navtex_rx {
+public:
+    // start: where the channel is resumed
+    worker_rx(shard_connection & coordinator, int channel, int sample_rate,
+              long long start) :
+        navtex_rx(sample_rate, false, false, nullptr, nullptr, nullptr),
+        m_coordinator(coordinator),
+        m_channel(channel),
+        m_lock_start(-1),
+        m_pending_start(start) {}
+
+    long long checkpoint() const {
+        if (message_pending())
+            return m_pending_start;
+        return m_lock_start != -1 ? m_lock_start : samples_in();
+    }
+
+protected:
+    void put_received_message(const ccir_message & ccir_msg,
+                              const std::string & message) override {
+        (void) ccir_msg;
+        m_coordinator.send("message " + std::to_string(m_channel) + " " +
+                           std::to_string(input_position()),
+                           message.data(), message.size());
+        // what is left (the header that cut the message) is from this lock
+        m_pending_start = m_lock_start != -1 ? m_lock_start : input_position();
+    }
+
+    void sync_changed(bool locked) override {
+        m_lock_start = locked ? input_position() : -1;
+        if (locked && !message_pending())
+            m_pending_start = m_lock_start;
+    }
+
+private:
+    shard_connection & m_coordinator;
+    int m_channel;
+    long long m_lock_start;
+    long long m_pending_start;
+};
+
+struct channel {
+    int id;
+    int fd;
+    mapped_recording recording;
+    std::unique_ptr<worker_rx> rx;
+    int sample_rate;
+    double speed;               // times real time (0: as fast as possible)
+    double started;             // when the channel was assigned
+    long long start;            // and from where
+    long long next_checkpoint;
+    double cpu;
+
+    channel() : fd(-1) {}
+    ~channel() {
+        if (fd != -1)
+            close(fd);
+    }
+};
+
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [options] socket\n", progname);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -h, --help  show this help\n");
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option long_options[] = {
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0,          nullptr, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = shard_connect(argv[optind]);
+    if (fd == -1) {
+        fprintf(stderr, "cannot connect to %s: %s\n", argv[optind], strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    shard_connection coordinator(fd);
+    coordinator.send("hello " + std::to_string(getpid()));
+
+    std::map<int, std::unique_ptr<channel>> channels;
+    double last_stats = now_seconds();
+    double last_cpu = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    bool quit = false;
+    while (!quit) {
+        // a channel is due when its input would have arrived by now
+        double now = now_seconds();
+        double wait = std::max(0.0, last_stats + stats_interval - now);
+        std::vector<channel *> due;
+        for (auto & entry : channels) {
+            channel & c = *entry.second;
+            long long position = c.rx->samples_in();
+            double time = c.speed > 0 ? c.started + (position + block_size - c.start) /
+                                        (c.sample_rate * c.speed) : now;
+            if (time <= now)
+                due.push_back(&c);
+            else
+                wait = std::min(wait, time - now);
+        }
+        struct pollfd pfd = { coordinator.fd(), POLLIN, 0 };
+        if (poll(&pfd, 1, due.empty() ? (int) (wait * 1000) + 1 : 0) > 0) {
+            if (!coordinator.receive())
+                break;
+            std::vector<std::string> fields;
+            std::string payload;
+            while (coordinator.next(fields, payload)) {
+                if (fields.empty())
+                    continue;
+                if (fields[0] == "quit") {
+                    quit = true;
+                } else if (fields[0] == "assign" && fields.size() >= 6) {
+                    int id = atoi(fields[1].c_str());
+                    std::string path = fields[5];
+                    for (size_t i = 6; i < fields.size(); i++)
+                        path += " " + fields[i];
+                    std::unique_ptr<channel> c(new channel());
+                    c->id = id;
+                    c->sample_rate = atoi(fields[2].c_str());
+                    c->start = atoll(fields[3].c_str());
+                    c->speed = atof(fields[4].c_str());
+                    c->fd = open(path.c_str(), O_RDONLY);
+                    if (c->fd == -1 || !c->recording.map(c->fd) || c->sample_rate <= 0) {
+                        coordinator.send("error " + fields[1] + " " + strerror(errno));
+                        continue;
+                    }
+                    c->start = std::min(c->start, c->recording.nb_samples());
+                    c->rx.reset(new worker_rx(coordinator, id, c->sample_rate, c->start));
+                    // the decoder needs some signal to settle before start
+                    seek_decoder(*c->rx, c->recording.data(), c->start,
+                                 (long long) recording_index::warm_up_margin * c->sample_rate);
+                    c->started = now_seconds();
+                    c->next_checkpoint = c->start + (long long) (checkpoint_interval * c->sample_rate);
+                    c->cpu = 0;
+                    channels[id] = std::move(c);
+                } else if (fields[0] == "revoke" && fields.size() >= 2) {
+                    auto entry = channels.find(atoi(fields[1].c_str()));
+                    if (entry != channels.end()) {
+                        coordinator.send("revoked " + fields[1] + " " +
+                                         std::to_string(entry->second->rx->checkpoint()));
+                        channels.erase(entry);
+                    }
+                }
+            }
+            continue;
+        }
+
+        // one block of each channel due, in turn
+        for (channel * c : due) {
+            long long position = c->rx->samples_in();
+            int n = std::min((long long) block_size, c->recording.nb_samples() - position);
+            double cpu_start = cpu_seconds(CLOCK_THREAD_CPUTIME_ID);
+            if (n > 0)
+                c->rx->process_data(c->recording.data() + position, n);
+            c->cpu += cpu_seconds(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+            position += n;
+            if (position >= c->next_checkpoint) {
+                c->next_checkpoint = position + (long long) (checkpoint_interval * c->sample_rate);
+                coordinator.send("checkpoint " + std::to_string(c->id) + " " +
+                                 std::to_string(c->rx->checkpoint()));
+            }
+        }
+        for (auto entry = channels.begin(); entry != channels.end();) {
+            channel & c = *entry->second;
+            if (c.rx->samples_in() < c.recording.nb_samples()) {
+                ++entry;
+                continue;
+            }
+            coordinator.send("stats " + std::to_string(entry->first) + " " +
+                             std::to_string(c.rx->samples_in()) + " " + std::to_string(c.cpu));
+            coordinator.send("done " + std::to_string(entry->first) + " " +
+                             std::to_string(c.rx->samples_in()));
+            entry = channels.erase(entry);
+        }
+
+        now = now_seconds();
+        if (now >= last_stats + stats_interval) {
+            for (auto & entry : channels)
+                coordinator.send("stats " + std::to_string(entry.first) + " " +
+                                 std::to_string(entry.second->rx->samples_in()) + " " +
+                                 std::to_string(entry.second->cpu));
+            double cpu = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID);
+            char load[32];
+            snprintf(load, sizeof(load), "load %.3f", (cpu - last_cpu) / (now - last_stats));
+            coordinator.send(load);
+            last_stats = now;
+            last_cpu = cpu;
+        }
+    }
+
+    return 0;
+}
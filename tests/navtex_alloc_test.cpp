@@ -0,0 +1,225 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// decode a recording (signed LE16 sampled at 11025Hz) and fail if the
+// decoder allocates any memory after the first second: operator new,
+// operator new[] and malloc() are replaced by versions that count the
+// calls once armed
+//
+// The recording is followed by synthetic FEC transmissions, so that
+// messages are delivered while armed too, in all the ways they end: with
+// NNNN, cut by the next header (with or without their own header), and
+// by the timeout
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "navtex_rx.h"
+
+#ifdef __GLIBC__
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t nmemb, size_t size);
+extern "C" void * __libc_realloc(void * ptr, size_t size);
+#endif
+
+constexpr int sample_rate = 11025;
+constexpr int block_size = 1024;
+// longest recording that can be tested (samples)
+constexpr size_t max_samples = 1 << 24;
+// of the synthetic transmissions
+constexpr double center_frequency = 1000;
+constexpr double shift = 170;
+constexpr double amplitude = 8000;
+constexpr double noise_level = 300;
+constexpr int baud = 100;
+constexpr int phasing = 100;        // phasing signals before the text
+constexpr double message_timeout = 30;
+
+static std::atomic<bool> armed(false);
+static std::atomic<long> allocations(0);
+
+static void count_allocation()
+{
+    if (armed.load(std::memory_order_relaxed))
+        allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+extern "C" void * malloc(size_t size)
+{
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t nmemb, size_t size)
+{
+    count_allocation();
+    return __libc_calloc(nmemb, size);
+}
+
+extern "C" void * realloc(void * ptr, size_t size)
+{
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+void * operator new(size_t size)
+{
+    count_allocation();
+    void * p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t size)
+{
+    count_allocation();
+    void * p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+
+// Synthetic FSK signal, with some noise, appended to samples
+class transmitter {
+public:
+    explicit transmitter(std::vector<short> & samples) :
+        m_samples(samples), m_noise(0, noise_level), m_phase(0), m_bit_end(0) {}
+
+    void silence(double seconds) {
+        for (long i = 0; i < seconds * sample_rate; i++)
+            put(0);
+    }
+
+    // A FEC transmission of text: the phasing signals, and then each
+    // character sent twice, as DX and four characters later as RX
+    void transmit(const std::string & text) {
+        CCIR476 ccir;
+        std::string codes;
+        bool shifted = false;
+        for (char c : text)
+            ccir.char_to_code(codes, c, shifted);
+        std::vector<int> slots(2 * (phasing + codes.size() + 4));
+        for (size_t i = 0; i < slots.size(); i++)
+            slots[i] = i % 2 ? 0x66 : 0x0f;
+        size_t base = 2 * phasing;
+        for (size_t m = 0; m < codes.size(); m++) {
+            slots[base + 2 * m + 1] = (unsigned char) codes[m];
+            slots[base + 2 * m + 6] = (unsigned char) codes[m];
+        }
+        m_bit_end = m_samples.size();
+        for (int code : slots)
+            for (int b = 0; b < 7; b++)
+                bit((code >> b) & 1);
+    }
+
+private:
+    std::vector<short> & m_samples;
+    std::mt19937 m_rng;
+    std::normal_distribution<double> m_noise;
+    double m_phase;
+    double m_bit_end;
+
+    void put(double value) {
+        value += m_noise(m_rng);
+        m_samples.push_back((short) std::max(-32768.0, std::min(32767.0, value)));
+    }
+
+    void bit(int mark) {
+        double f = center_frequency + (mark ? shift : -shift) / 2;
+        m_bit_end += (double) sample_rate / baud;
+        while (m_samples.size() < m_bit_end) {
+            m_phase += 2 * M_PI * f / sample_rate;
+            put(amplitude * sin(m_phase));
+        }
+    }
+}; // transmitter
+
+int main(int argc, char** argv)
+{
+    bool compact = argc == 3 && strcmp(argv[1], "--compact") == 0;
+    if (argc != 2 && !compact) {
+        fprintf(stderr, "usage: %s [--compact] file\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char * path = argv[argc - 1];
+
+    FILE * in = fopen(path, "rb");
+    if (in == nullptr) {
+        fprintf(stderr, "fopen(%s) failed: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    std::vector<short> samples(max_samples);
+    samples.resize(fread(samples.data(), sizeof(short), max_samples, in));
+    fclose(in);
+    size_t recording_samples = samples.size();
+
+    transmitter tx(samples);
+    tx.silence(5);
+    tx.transmit("ZCZC IA76\r\nGALE WARNING 123\r\nNNNN\r\n");
+    tx.silence(5);
+    tx.transmit("ZCZC EB12\r\nNO TRAILER\r\nZCZC EC13\r\nTHIRD MESSAGE\r\nNNNN\r\n");
+    tx.silence(5);
+    tx.transmit("ZCZC ED14\r\nTIMED OUT\r\n");
+    tx.silence(message_timeout + 10);
+    size_t nb_samples = samples.size();
+
+    // the output goes through buffers set up before arming
+    static char raw_buffer[1 << 16];
+    static char messages_buffer[1 << 16];
+    FILE * raw = fopen("/dev/null", "w");
+    FILE * messages = fopen("/dev/null", "w");
+    if (raw == nullptr || messages == nullptr) {
+        fprintf(stderr, "fopen(/dev/null) failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(raw, raw_buffer, _IOFBF, sizeof(raw_buffer));
+    setvbuf(messages, messages_buffer, _IOFBF, sizeof(messages_buffer));
+
+    navtex_rx nv(sample_rate, false, false, raw, messages, nullptr, compact);
+    nv.set_message_timeout(message_timeout);
+    navtex_stats recording_stats = nv.stats();
+    for (size_t i = 0; i < nb_samples; i += block_size) {
+        if (i >= (size_t) sample_rate)
+            armed = true;
+        int n = std::min((size_t) block_size, nb_samples - i);
+        nv.process_data(samples.data() + i, n);
+        if (i < recording_samples && i + n >= recording_samples)
+            recording_stats = nv.stats();
+    }
+    armed = false;
+
+    // in the synthetic part: IA76 and EC13 complete, EB12 cut by the next
+    // header, ED14 timed out
+    navtex_stats stats = nv.stats();
+    long long headers = stats.headers - recording_stats.headers;
+    long long delivered = stats.messages - recording_stats.messages;
+    long long complete = stats.complete_messages - recording_stats.complete_messages;
+    printf("%s (%s): %ld allocations after the first second, then %lld headers, %lld messages, %lld complete\n",
+           path, compact ? "compact" : "normal", allocations.load(), headers, delivered,
+           complete);
+    if (headers != 4 || complete != 2 || delivered < 4) {
+        fprintf(stderr, "the synthetic messages were not all delivered\n");
+        return EXIT_FAILURE;
+    }
+    return allocations.load() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
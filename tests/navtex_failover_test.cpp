@@ -0,0 +1,203 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2020 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// failover of a navtex_worker channel: a worker decoding a recording
+// (signed LE16 sampled at 11025Hz) with a message without NNNN, followed
+// by noise, is killed after the end of the signal but before the message
+// is delivered (by the timeout, ten minutes later); a second worker
+// resumes the channel from the last checkpoint of the first one, and the
+// test fails unless it delivers the message
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "navtex_shard.h"
+
+constexpr int sample_rate = 11025;
+// longest recording that can be tested (samples)
+constexpr size_t max_samples = 1 << 24;
+// noise after the recording: longer than the message timeout
+constexpr double noise_seconds = 700;
+constexpr double noise_level = 300;
+// speed of the first worker (times real time), and how far past the end
+// of the recording it is killed (s)
+constexpr double first_speed = 20;
+constexpr double kill_after = 10;
+// longest wait for a worker (s)
+constexpr double timeout = 120;
+// in the message of the example recording
+static const char * expected_text = "NOW IS THE TIME";
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static pid_t start_worker(const char * program, const std::string & socket_path)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(program, program, socket_path.c_str(), (char *) nullptr);
+        fprintf(stderr, "cannot run %s: %s\n", program, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// The connection of the next worker, or -1
+static int accept_worker(int listen_fd)
+{
+    struct pollfd pfd = { listen_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, (int) (timeout * 1000)) <= 0)
+        return -1;
+    return accept(listen_fd, nullptr, nullptr);
+}
+
+// Wait for the next message of worker; false if it is gone or silent
+static bool next_message(shard_connection & worker, std::vector<std::string> & fields,
+                         std::string & payload)
+{
+    double deadline = now_seconds() + timeout;
+    while (!worker.next(fields, payload)) {
+        struct pollfd pfd = { worker.fd(), POLLIN, 0 };
+        int wait = (int) ((deadline - now_seconds()) * 1000);
+        if (wait <= 0 || poll(&pfd, 1, wait) <= 0 || !worker.receive())
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s worker_program file\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char * worker_program = argv[1];
+    const char * path = argv[2];
+
+    FILE * in = fopen(path, "rb");
+    if (in == nullptr) {
+        fprintf(stderr, "fopen(%s) failed: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    std::vector<short> samples(max_samples);
+    samples.resize(fread(samples.data(), sizeof(short), max_samples, in));
+    fclose(in);
+    long long recording_samples = samples.size();
+    std::mt19937 rng;
+    std::normal_distribution<double> noise(0, noise_level);
+    for (long i = 0; i < noise_seconds * sample_rate; i++)
+        samples.push_back((short) noise(rng));
+
+    std::string base = "/tmp/navtex_failover_test." + std::to_string(getpid());
+    std::string input_path = base + ".raw";
+    std::string socket_path = base + ".sock";
+    FILE * out = fopen(input_path.c_str(), "wb");
+    if (out == nullptr ||
+        fwrite(samples.data(), sizeof(short), samples.size(), out) != samples.size() ||
+        fclose(out) != 0) {
+        fprintf(stderr, "cannot write %s\n", input_path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    int listen_fd = shard_listen(socket_path);
+    if (listen_fd == -1) {
+        fprintf(stderr, "cannot listen on %s: %s\n", socket_path.c_str(), strerror(errno));
+        unlink(input_path.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    bool ok = true;
+    std::vector<std::string> fields;
+    std::string payload;
+
+    // the first worker, killed past the end of the recording
+    long long checkpoint = -1;
+    bool delivered_before = false;
+    pid_t first = start_worker(worker_program, socket_path);
+    int fd = accept_worker(listen_fd);
+    if (fd == -1) {
+        fprintf(stderr, "the first worker did not connect\n");
+        ok = false;
+    } else {
+        shard_connection worker(fd);
+        worker.send("assign 0 " + std::to_string(sample_rate) + " 0 " +
+                    std::to_string(first_speed) + " " + input_path);
+        long long kill_position = recording_samples + (long long) (kill_after * sample_rate);
+        for (;;) {
+            if (!next_message(worker, fields, payload)) {
+                fprintf(stderr, "the first worker went away\n");
+                ok = false;
+                break;
+            }
+            if (fields[0] == "checkpoint" && fields.size() >= 3) {
+                checkpoint = atoll(fields[2].c_str());
+            } else if (fields[0] == "message") {
+                delivered_before = delivered_before || payload.find(expected_text) != std::string::npos;
+            } else if (fields[0] == "stats" && fields.size() >= 3 &&
+                       atoll(fields[2].c_str()) >= kill_position) {
+                break;
+            }
+        }
+    }
+    kill(first, SIGKILL);
+    waitpid(first, nullptr, 0);
+    if (ok && (checkpoint == -1 || delivered_before)) {
+        fprintf(stderr, "the message was delivered before the failover, or there was no checkpoint\n");
+        ok = false;
+    }
+
+    // the second worker, from the last checkpoint
+    bool delivered = false;
+    if (ok) {
+        pid_t second = start_worker(worker_program, socket_path);
+        fd = accept_worker(listen_fd);
+        if (fd == -1) {
+            fprintf(stderr, "the second worker did not connect\n");
+            ok = false;
+        } else {
+            shard_connection worker(fd);
+            worker.send("assign 0 " + std::to_string(sample_rate) + " " +
+                        std::to_string(checkpoint) + " 0 " + input_path);
+            for (;;) {
+                if (!next_message(worker, fields, payload)) {
+                    fprintf(stderr, "the second worker went away\n");
+                    ok = false;
+                    break;
+                }
+                if (fields[0] == "message")
+                    delivered = delivered || payload.find(expected_text) != std::string::npos;
+                else if (fields[0] == "done" || fields[0] == "error")
+                    break;
+            }
+            worker.send("quit");
+        }
+        waitpid(second, nullptr, 0);
+    }
+
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    unlink(input_path.c_str());
+
+    printf("%s: resumed at %.1f s (end of the recording at %.1f s), message %s\n", path,
+           (double) checkpoint / sample_rate, (double) recording_samples / sample_rate,
+           delivered ? "delivered" : "lost");
+    return ok && delivered ? EXIT_SUCCESS : EXIT_FAILURE;
+}